@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "pagetable.h"
+#include "sim.h"
+
+// Width of the per-frame history, at most 32 bits.
+#ifndef AGING_BITS
+#define AGING_BITS 8
+#endif
+
+extern int debug;
+
+// age[frame] is a shift register of the reference bit of the page in frame,
+// sampled at every timer tick, with the most recent tick in the top bit.
+// The page whose register holds the smallest number was used least recently.
+static __thread unsigned *age;
+static __thread int hand;   // Where the next search for a victim starts
+
+/*
+ * Timer tick: shifts every frame's reference bit into its age and clears it.
+ * find_physpage runs it (as tick_fcn) every aging_period references, so pages
+ * read ahead do not move the timer.
+ */
+void aging_tick() {
+	unsigned i;
+
+	for (i = 0; i < memsize; i++) {
+		pgtbl_entry_t *p = coremap.pte[i];
+
+		if (p == NULL)
+			break; // Frames are handed out in order
+		age[i] >>= 1;
+		if (p->frame & PG_REF) {
+			age[i] |= 1u << (AGING_BITS - 1);
+			p->frame &= ~PG_REF;
+		}
+	}
+}
+
+/* Page to evict is chosen using the aging algorithm: the frame with the
+ * smallest age. A reference since the last tick breaks ties, and remaining
+ * ties go to the first frame found from the hand.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int aging_evict() {
+
+	int victim = -1;
+	unsigned i;
+
+	for (i = 0; i < memsize; i++) {
+		int f = (hand + i) % memsize;
+
+		if (!frame_evictable(f))
+			continue; // Under local replacement, not a candidate
+		if (victim == -1 || age[f] < age[victim] ||
+		    (age[f] == age[victim] &&
+		     (coremap.pte[victim]->frame & PG_REF) &&
+		     !(coremap.pte[f]->frame & PG_REF)))
+			victim = f;
+	}
+	assert(victim != -1);
+	hand = (victim + 1) % memsize;
+	return victim;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the aging algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void aging_ref(pgtbl_entry_t *p) {
+
+	// The page table sets the reference bit and runs the timer.
+	return;
+}
+
+/* This function is called by allocate_frame each time a frame is given to a
+ * new page, which starts with no history.
+ */
+void aging_alloc(int frame) {
+	age[frame] = 0;
+}
+
+/* Initialize any data structures needed for this replacement
+ * algorithm.
+ */
+void aging_init() {
+	assert(AGING_BITS >= 1 && AGING_BITS <= 32);
+
+	// Free what an earlier simulation on this thread left, if any.
+	free(age);
+	if ((age = calloc(memsize, sizeof(unsigned))) == NULL) {
+		perror("aging: failed to allocate ages");
+		exit(1);
+	}
+	hand = 0;
+}
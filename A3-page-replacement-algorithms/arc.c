@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "pagetable.h"
+#include "pagelist.h"
+#include "sim.h"
+
+
+extern int debug;
+
+/* Adaptive Replacement Cache (Megiddo and Modha, FAST 2003).
+ *
+ * Resident pages are on T1 (seen once recently) or T2 (seen at least twice),
+ * and recently evicted pages are remembered on the ghost lists B1 and B2.
+ * A hit on a ghost in B1 means T1 should have been bigger, so the target
+ * size p of T1 grows; a hit on a ghost in B2 shrinks it. All lists are
+ * ordered from least to most recently used.
+ *
+ * A page brought in without a reference (read ahead, or to fill a huge
+ * page) goes on T1 but has not been seen yet: its first reference keeps it
+ * on T1, and if it is evicted before that it leaves no ghost.
+ */
+#define UNREF (0x1)  // Brought in without a reference, not referenced since
+
+static __thread struct pl_pool pool;
+static __thread struct pl_list t1, t2, b1, b2;
+static __thread int p;       // Target size of T1
+
+/* Evicts the LRU page of T1 or T2, as chosen by p, and remembers it on the
+ * matching ghost list. in_b2 is true if the incoming page is a B2 ghost.
+ * Returns the frame that was freed.
+ */
+static int arc_replace(int in_b2) {
+	int n, frame;
+
+	if (t1.len > 0 &&
+	    (t2.len == 0 || t1.len > p || (in_b2 && t1.len == p))) {
+		n = t1.head;
+		pl_remove(&pool, &t1, n);
+		if (PL_NODE(&pool, n)->flags & UNREF) {
+			frame = PL_NODE(&pool, n)->frame;
+			pl_free(&pool, n);
+			return frame;
+		}
+		pl_push(&pool, &b1, n);
+	} else {
+		n = t2.head;
+		pl_remove(&pool, &t2, n);
+		pl_push(&pool, &b2, n);
+	}
+	return pl_make_ghost(&pool, n);
+}
+
+/* Forgets the LRU ghost on l.
+ */
+static void arc_drop(struct pl_list *l) {
+	int n = l->head;
+
+	pl_remove(&pool, l, n);
+	pl_free(&pool, n);
+}
+
+/* Page to evict is chosen using the ARC algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int arc_evict() {
+	int n = pl_find(&pool, incoming_pte);
+	int delta, frame;
+
+	// Bringing a page in without a reference is not a ghost hit.
+	if (incoming_pte->frame & (PG_PREFETCH | PG_HUGEFILL))
+		n = -1;
+
+	if (n != -1 && PL_NODE(&pool, n)->on[0] == &b1) {
+		// Ghost hit in B1: favour recency.
+		delta = b1.len >= b2.len ? 1 : b2.len / b1.len;
+		p = p + delta < memsize ? p + delta : memsize;
+		return arc_replace(0);
+	}
+	if (n != -1 && PL_NODE(&pool, n)->on[0] == &b2) {
+		// Ghost hit in B2: favour frequency.
+		delta = b2.len >= b1.len ? 1 : b1.len / b2.len;
+		p = p - delta > 0 ? p - delta : 0;
+		return arc_replace(1);
+	}
+
+	// A page ARC has no history for.
+	if (t1.len + b1.len == memsize) {
+		if (t1.len < memsize) {
+			arc_drop(&b1);
+			return arc_replace(0);
+		}
+		// T1 fills memory: evict its LRU page without a ghost.
+		n = t1.head;
+		pl_remove(&pool, &t1, n);
+		frame = PL_NODE(&pool, n)->frame;
+		pl_free(&pool, n);
+		return frame;
+	}
+	if (t1.len + t2.len + b1.len + b2.len >= 2 * memsize) {
+		arc_drop(&b2);
+	}
+	return arc_replace(0);
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the arc algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void arc_ref(pgtbl_entry_t *pte) {
+	int frame = pte->frame >> PAGE_SHIFT;
+	int n = pl_find(&pool, pte);
+
+	if (n == -1) {
+		// New page, arc_evict already made room for it.
+		n = pl_new(&pool, pte);
+		pl_set_frame(&pool, n, frame);
+		pl_push(&pool, &t1, n);
+		return;
+	}
+
+	// First reference to a page brought in without one: seen once.
+	if (PL_NODE(&pool, n)->flags & UNREF) {
+		PL_NODE(&pool, n)->flags &= ~UNREF;
+		pl_remove(&pool, &t1, n);
+		pl_push(&pool, &t1, n);
+		return;
+	}
+
+	// Hit in T1 or T2, or a ghost that was just brought back in: either way
+	// the page has now been seen twice.
+	pl_remove(&pool, PL_NODE(&pool, n)->on[0], n);
+	if (PL_NODE(&pool, n)->frame == -1) {
+		pl_set_frame(&pool, n, frame);
+	}
+	pl_push(&pool, &t2, n);
+}
+
+/* This function is called when a page is brought in without a reference
+ * (read ahead, or to fill a huge page). Any ghost of the page is forgotten,
+ * as this is not a hit.
+ */
+void arc_insert(pgtbl_entry_t *pte) {
+	int n = pl_find(&pool, pte);
+
+	if (n != -1) {
+		pl_remove(&pool, PL_NODE(&pool, n)->on[0], n);
+		pl_free(&pool, n);
+	}
+	n = pl_new(&pool, pte);
+	pl_set_frame(&pool, n, pte->frame >> PAGE_SHIFT);
+	PL_NODE(&pool, n)->flags = UNREF;
+	pl_push(&pool, &t1, n);
+}
+
+/* Initializes any data structures needed for this
+ * replacement algorithm.
+ */
+void arc_init() {
+	// At most memsize resident pages and memsize ghosts.
+	pl_pool_init(&pool, 2 * memsize + 1);
+	pl_list_init(&t1, 0);
+	pl_list_init(&t2, 0);
+	pl_list_init(&b1, 0);
+	pl_list_init(&b2, 0);
+	p = 0;
+}
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "trace.h"
+
+/* Benchmark of the simulator itself (sim -B). Synthetic traces of a given
+ * length are replayed by each replacement algorithm, and one CSV line per
+ * (trace, algorithm) pair gives the replay throughput, the peak resident
+ * memory, and the average time spent in the algorithm's ref and evict
+ * functions.
+ *
+ * Each pair runs in its own child process, which generates the trace, so
+ * that the peak RSS is that of one simulation. The trace is replayed twice:
+ * once as is for the throughput, and once with timed ref and evict
+ * functions, whose clock reads would otherwise slow the replay down.
+ */
+
+// Virtual addresses in traces have 36 bits.
+#define MAX_PAGES (1UL << 24)
+
+// Synthetic trace generators. Every generator gets the reference number i,
+// the total number of references and the number of distinct pages, and
+// returns the page referenced.
+struct generator {
+	char *name;
+	addr_t (*page)(unsigned long i, unsigned long len,
+		       unsigned long pages);
+};
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+// xorshift64*, so that traces are the same on every run and platform.
+static uint64_t rng() {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static addr_t gen_uniform(unsigned long i, unsigned long len,
+			  unsigned long pages) {
+	return rng() % pages;
+}
+
+// Zipf (s = 1) over the pages, with ranks shuffled over the address range.
+static double *zipf_cdf;
+static addr_t *zipf_rank;
+
+static addr_t gen_zipf(unsigned long i, unsigned long len,
+		       unsigned long pages) {
+	double u = (double)(rng() >> 11) / (1ULL << 53);
+	unsigned long lo = 0, hi = pages - 1;
+
+	if (zipf_cdf == NULL) {
+		double sum = 0;
+		unsigned long j;
+
+		zipf_cdf = malloc(pages * sizeof(double));
+		zipf_rank = malloc(pages * sizeof(addr_t));
+		if (zipf_cdf == NULL || zipf_rank == NULL) {
+			perror("bench: failed to allocate Zipf table");
+			exit(1);
+		}
+		for (j = 0; j < pages; j++) {
+			sum += 1.0 / (j + 1);
+			zipf_cdf[j] = sum;
+			zipf_rank[j] = j;
+		}
+		for (j = 0; j < pages; j++) {
+			unsigned long k = j + rng() % (pages - j);
+			addr_t tmp = zipf_rank[j];
+
+			zipf_cdf[j] /= sum;
+			zipf_rank[j] = zipf_rank[k];
+			zipf_rank[k] = tmp;
+		}
+	}
+	while (lo < hi) {
+		unsigned long mid = (lo + hi) / 2;
+
+		if (zipf_cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return zipf_rank[lo];
+}
+
+static addr_t gen_loop(unsigned long i, unsigned long len,
+		       unsigned long pages) {
+	return i % pages;
+}
+
+// Every reference is to a new page.
+static addr_t gen_scan(unsigned long i, unsigned long len,
+		       unsigned long pages) {
+	return i % MAX_PAGES;
+}
+
+// Eight phases, each uniform over a quarter of the pages, half of them
+// shared with the previous phase.
+static addr_t gen_phase(unsigned long i, unsigned long len,
+			unsigned long pages) {
+	unsigned long phase = i / ((len + 7) / 8);
+	unsigned long width = pages / 4 > 0 ? pages / 4 : 1;
+
+	return (phase * width / 2 + rng() % width) % pages;
+}
+
+static struct generator generators[] = {
+	{"uniform", gen_uniform},
+	{"zipf", gen_zipf},
+	{"loop", gen_loop},
+	{"scan", gen_scan},
+	{"phase", gen_phase}
+};
+static int num_generators = sizeof(generators) / sizeof(generators[0]);
+
+/* Returns the trace of len references made by gen, as binary records.
+ * One reference in four is a store.
+ */
+static uint64_t *generate(struct generator *gen, unsigned long len,
+			  unsigned long pages) {
+	uint64_t *recs = malloc(len * sizeof(uint64_t));
+	unsigned long i;
+
+	if (recs == NULL) {
+		perror("bench: failed to allocate trace");
+		exit(1);
+	}
+	for (i = 0; i < len; i++) {
+		addr_t vaddr = gen->page(i, len, pages) << PAGE_SHIFT;
+
+		recs[i] = trace_pack_ref(rng() % 4 == 0 ? 'S' : 'L', vaddr,
+					 0);
+	}
+	return recs;
+}
+
+static double now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The algorithm's own functions, called by the timed ones.
+static void (*alg_ref)(pgtbl_entry_t *);
+static int (*alg_evict)();
+static unsigned long ref_calls, evict_calls;
+static double ref_ns, evict_ns;
+
+static void timed_ref(pgtbl_entry_t *p) {
+	double start = now_ns();
+
+	alg_ref(p);
+	ref_ns += now_ns() - start;
+	ref_calls++;
+}
+
+static int timed_evict() {
+	double start = now_ns();
+	int frame = alg_evict();
+
+	evict_ns += now_ns() - start;
+	evict_calls++;
+	return frame;
+}
+
+/* Returns the time taken by a clock read, which is subtracted from every
+ * timed call.
+ */
+static double timer_overhead() {
+	double start = now_ns();
+	int i;
+
+	for (i = 0; i < 1000000; i++)
+		now_ns();
+	return (now_ns() - start) / 1000000;
+}
+
+/* Returns the average time of calls that took ns in total, without the
+ * clock reads.
+ */
+static double per_call(double ns, unsigned long calls, double overhead) {
+	double avg = calls > 0 ? ns / calls - overhead : 0;
+
+	return avg > 0 ? avg : 0;
+}
+
+/* Runs one benchmark in a child process, and prints its CSV line.
+ */
+static void bench_one(struct generator *gen, struct functions *alg,
+		      unsigned long len, unsigned long pages, unsigned msize,
+		      double overhead) {
+	struct trace trace;
+	struct rusage usage;
+	unsigned long distinct;
+	double start, elapsed;
+	int misses;
+
+	trace_recs = generate(gen, len, pages);
+	trace_len = len;
+	// Swap for every page, as each one may be written.
+	distinct = pages;
+	if (gen->page == gen_scan)
+		distinct = len < MAX_PAGES ? len : MAX_PAGES;
+
+	sim_start(alg, msize, distinct);
+	trace_from_records(&trace, trace_recs, trace_len);
+	start = now_ns();
+	replay_trace(&trace);
+	elapsed = now_ns() - start;
+	misses = miss_count;
+	sim_stop();
+
+	sim_start(alg, msize, distinct);
+	alg_ref = ref_fcn;
+	alg_evict = evict_fcn;
+	ref_fcn = timed_ref;
+	evict_fcn = timed_evict;
+	trace_from_records(&trace, trace_recs, trace_len);
+	replay_trace(&trace);
+	sim_stop();
+
+	getrusage(RUSAGE_SELF, &usage);
+	printf("%s,%s,%u,%lu,%lu,%d,%.0f,%ld,%lu,%.1f,%lu,%.1f\n",
+	       gen->name, alg->name, msize, pages, len, misses,
+	       len / (elapsed / 1e9), usage.ru_maxrss,
+	       ref_calls, per_call(ref_ns, ref_calls, overhead),
+	       evict_calls, per_call(evict_ns, evict_calls, overhead));
+}
+
+/* Benchmarks every algorithm in alg_list (num_alg_list of them) on every
+ * synthetic trace of len references over the given number of distinct
+ * pages, with msize frames.
+ */
+void bench(struct functions **alg_list, int num_alg_list, unsigned long len,
+	   unsigned long pages, unsigned msize) {
+	double overhead = timer_overhead();
+	int g, a;
+
+	if (pages > MAX_PAGES)
+		pages = MAX_PAGES;
+	printf("trace,algorithm,memsize,pages,references,misses,refs_per_sec,"
+	       "peak_rss_kb,ref_calls,ns_per_ref,evict_calls,ns_per_evict\n");
+	fflush(stdout);
+	for (g = 0; g < num_generators; g++) {
+		for (a = 0; a < num_alg_list; a++) {
+			pid_t pid = fork();
+			int status;
+
+			if (pid == -1) {
+				perror("bench: fork failed");
+				exit(1);
+			}
+			if (pid == 0) {
+				bench_one(&generators[g], alg_list[a], len,
+					  pages, msize, overhead);
+				fflush(stdout);
+				_exit(0);
+			}
+			if (waitpid(pid, &status, 0) == -1 ||
+			    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				fprintf(stderr, "bench: %s on %s failed\n",
+					alg_list[a]->name, generators[g].name);
+				exit(1);
+			}
+		}
+	}
+}
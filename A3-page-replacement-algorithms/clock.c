@@ -4,15 +4,55 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include "pagetable.h"
+#include "sim.h"
+#include "stats.h"
 
 
-extern int memsize;
-
 extern int debug;
 
-extern struct frame *coremap;
+__thread int clock_hand;
+
+// The reference bit of the page in each frame, mirrored from its page table
+// entry by clock_ref, 64 frames to a word. Scanning the packed bits skips a
+// run of referenced frames a word at a time, instead of following the
+// pte pointer of every frame. Bits past memsize are never used.
+static __thread uint64_t *ref_bits;
+static __thread unsigned ref_words;
+
+#define REF_WORD(frame)  ((frame) / 64)
+#define REF_BIT(frame)   (1ULL << ((frame) % 64))
+
+/* Returns the mask of the bits of word w that belong to frames.
+ */
+static inline uint64_t frames_in_word(unsigned w) {
+	if (w == ref_words - 1 && memsize % 64 != 0)
+		return (1ULL << (memsize % 64)) - 1;
+	return ~0ULL;
+}
+
+/* clock_evict under local replacement, one frame at a time, skipping the
+ * frames that may not be taken without clearing their reference bit.
+ */
+static int clock_evict_local() {
+
+	unsigned long scanned = 0;
 
-int clock_hand;
+	while (1) {
+		int frame = clock_hand;
+
+		scanned++;
+		clock_hand = (clock_hand + 1) % memsize;
+		if (!frame_evictable(frame)) {
+			// Under local replacement, not a candidate.
+			continue;
+		} else if (ref_bits[REF_WORD(frame)] & REF_BIT(frame)) {
+			ref_bits[REF_WORD(frame)] &= ~REF_BIT(frame);
+		} else {
+			STATS_SCAN(scanned);
+			return frame;
+		}
+	}
+}
 
 /* Page to evict is chosen using the clock algorithm.
  * Returns the page frame number (which is also the index in the coremap)
@@ -21,22 +61,35 @@ int clock_hand;
 
 int clock_evict() {
 
-	// Cycle through frames until a vicitim is found
-	while (1){
-		struct frame victim = coremap[clock_hand];
+	unsigned w = REF_WORD(clock_hand);
+	uint64_t from = ~0ULL << (clock_hand % 64); // Bits at or after the hand
+	unsigned n;
 
-		if (victim.pte->frame & PG_REF){
-			// Ensures algorithm will halt
-			victim.pte->frame &= ~PG_REF;
-			clock_hand = (clock_hand + 1) % memsize;
+	if (evict_from != EVICT_ANY)
+		return clock_evict_local();
 
-		} else {
-			// Found victim.
-			int returnVal = clock_hand;
-			clock_hand = (clock_hand + 1) % memsize;
-			return returnVal;
+	// The victim is the first unreferenced frame from the hand on, and
+	// the frames passed on the way lose their reference bit. If every
+	// frame is referenced, the hand comes back to its own, now cleared,
+	// frame in the last word.
+	for (n = 0; n <= ref_words; n++) {
+		uint64_t unref = ~ref_bits[w] & from & frames_in_word(w);
+
+		if (unref != 0) {
+			int victim = w * 64 + __builtin_ctzll(unref);
+
+			ref_bits[w] &= ~(from & (REF_BIT(victim) - 1));
+			STATS_SCAN((victim - clock_hand + memsize) % memsize +
+				   (n > 0 && victim == clock_hand ? memsize : 0) +
+				   1);
+			clock_hand = (victim + 1) % memsize;
+			return victim;
 		}
+		ref_bits[w] &= ~from;
+		w = w + 1 == ref_words ? 0 : w + 1;
+		from = ~0ULL;
 	}
+	assert(0);
 	return 0;
 }
 
@@ -46,12 +99,32 @@ int clock_evict() {
  */
 void clock_ref(pgtbl_entry_t *p) {
 
+	int frame = p->frame >> PAGE_SHIFT;
+
+	ref_bits[REF_WORD(frame)] |= REF_BIT(frame);
 	return;
 }
 
+/* This function is called when a page is brought in without a reference
+ * (read ahead, or to fill a huge page). It comes in unreferenced, so the
+ * hand takes it on its first pass unless it is used by then.
+ */
+void clock_insert(pgtbl_entry_t *p) {
+
+	int frame = p->frame >> PAGE_SHIFT;
+
+	ref_bits[REF_WORD(frame)] &= ~REF_BIT(frame);
+}
+
 /* Initialize any data structures needed for this replacement
  * algorithm.
  */
 void clock_init() {
 	clock_hand = 0;
+	free(ref_bits);
+	ref_words = (memsize + 63) / 64;
+	if ((ref_bits = calloc(ref_words, sizeof(uint64_t))) == NULL) {
+		perror("clock: failed to allocate reference bits");
+		exit(1);
+	}
 }
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "pagetable.h"
+#include "pagelist.h"
+#include "sim.h"
+#include "stats.h"
+
+
+extern int debug;
+
+/* CLOCK-Pro (Jiang, Chen and Zhang, USENIX 2005), an approximation of LIRS
+ * built on a clock.
+ *
+ * One circular list holds hot and cold resident pages, plus evicted cold
+ * pages that are still in their test period. A cold page that is referenced
+ * during its test period has a short reuse distance and becomes hot. Three
+ * hands go round the clock: the cold hand looks for a cold victim, the hot
+ * hand turns unreferenced hot pages cold, and the test hand ends test
+ * periods to bound how many evicted pages are remembered. The number of
+ * frames for cold pages, mc, adapts: it grows when an evicted page in its
+ * test period is referenced, and shrinks when a test period ends unused.
+ *
+ * New pages are inserted at the list head, which is just behind the hot
+ * hand, the last place any hand will reach. Resident cold pages are also
+ * on a second list in the order they became cold, which is the order the
+ * cold hand meets them in: the cold hand is the head of that list, so it
+ * never steps over hot pages or ghosts, and only the hot and test hands go
+ * round the whole clock. Each cold page it looks at is either evicted or
+ * had its reference bit set since the last time, so evictions take O(1)
+ * amortized steps.
+ */
+#define HOT  (0x1)  // Hot page, otherwise cold
+#define TEST (0x2)  // Cold page in its test period
+#define REF  (0x4)  // Referenced since a hand last passed
+
+static __thread struct pl_pool pool;
+static __thread struct pl_list clk;
+static __thread struct pl_list cold;  // Resident cold pages, cold hand first
+static __thread int hand_hot, hand_test;
+static __thread int nhot;    // Resident hot pages
+static __thread int nghost;  // Evicted cold pages in their test period
+static __thread int mc;      // Target number of resident cold pages
+
+/* Takes node n off the clock, moving any hand on it to the next node.
+ */
+static void clockpro_remove(int n) {
+	int next = clk.len > 1 ? pl_next(&pool, &clk, n) : -1;
+
+	if (hand_hot == n)
+		hand_hot = next;
+	if (hand_test == n)
+		hand_test = next;
+	pl_remove(&pool, &clk, n);
+}
+
+/* Puts node n on the clock at the list head.
+ */
+static void clockpro_add(int n) {
+	if (clk.len == 0) {
+		pl_push(&pool, &clk, n);
+		hand_hot = hand_test = n;
+	} else {
+		pl_insert_before(&pool, &clk, n, hand_hot);
+	}
+}
+
+/* Ends the test period of cold page n, forgetting it if it was evicted.
+ * It was not referenced in time, so cold pages get fewer frames.
+ */
+static void clockpro_end_test(int n) {
+	struct pl_node *node = PL_NODE(&pool, n);
+
+	node->flags &= ~TEST;
+	if (mc > 1)
+		mc--;
+	if (node->frame == -1) {
+		clockpro_remove(n);
+		pl_free(&pool, n);
+		nghost--;
+	}
+}
+
+/* Moves the hot hand one step.
+ */
+static void clockpro_hand_hot() {
+	int n = hand_hot;
+	struct pl_node *node = PL_NODE(&pool, n);
+
+	hand_hot = pl_next(&pool, &clk, n);
+	if (node->flags & HOT) {
+		if (node->flags & REF) {
+			node->flags &= ~REF;
+		} else {
+			node->flags &= ~HOT;
+			nhot--;
+			pl_push(&pool, &cold, n);
+		}
+	} else if (node->flags & TEST) {
+		clockpro_end_test(n);
+	}
+}
+
+/* Moves the test hand one step.
+ */
+static void clockpro_hand_test() {
+	int n = hand_test;
+	struct pl_node *node = PL_NODE(&pool, n);
+
+	hand_test = pl_next(&pool, &clk, n);
+	if (!(node->flags & HOT) && (node->flags & TEST)) {
+		clockpro_end_test(n);
+	}
+}
+
+/* Runs the hot hand until hot pages fit in the frames not kept for cold
+ * pages.
+ */
+static void clockpro_balance() {
+	while (nhot > 0 && nhot > memsize - mc) {
+		clockpro_hand_hot();
+	}
+}
+
+/* Page to evict is chosen using the clockpro algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int clockpro_evict() {
+	int n, frame;
+	struct pl_node *node;
+	unsigned long scanned = 0;
+
+	while (1) {
+		scanned++;
+		// Promotions can leave no cold page to evict.
+		while (cold.len == 0) {
+			clockpro_hand_hot();
+		}
+
+		n = cold.head;
+		node = PL_NODE(&pool, n);
+		pl_remove(&pool, &cold, n);
+
+		if (node->flags & REF) {
+			// Referenced cold page: hot if still in its test
+			// period, otherwise it starts a new one. Either way it
+			// moves to the list head.
+			node->flags &= ~REF;
+			clockpro_remove(n);
+			if (node->flags & TEST) {
+				node->flags = (node->flags & ~TEST) | HOT;
+				nhot++;
+				clockpro_add(n);
+				clockpro_balance();
+			} else {
+				node->flags |= TEST;
+				clockpro_add(n);
+				pl_push(&pool, &cold, n);
+			}
+			continue;
+		}
+
+		// Unreferenced cold page: the victim.
+		if (node->flags & TEST) {
+			// Remember it until its test period ends.
+			frame = pl_make_ghost(&pool, n);
+			nghost++;
+			while (nghost > memsize) {
+				clockpro_hand_test();
+			}
+		} else {
+			frame = node->frame;
+			clockpro_remove(n);
+			pl_free(&pool, n);
+		}
+		STATS_SCAN(scanned);
+		return frame;
+	}
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the clockpro algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void clockpro_ref(pgtbl_entry_t *p) {
+	int frame = p->frame >> PAGE_SHIFT;
+	int n = pl_find(&pool, p);
+	struct pl_node *node;
+
+	if (n == -1) {
+		// New page: hot while memory fills up, cold in its test period
+		// after that.
+		n = pl_new(&pool, p);
+		pl_set_frame(&pool, n, frame);
+		node = PL_NODE(&pool, n);
+		if (nhot < memsize - mc) {
+			node->flags = HOT;
+			nhot++;
+		} else {
+			node->flags = TEST;
+			pl_push(&pool, &cold, n);
+		}
+		clockpro_add(n);
+		return;
+	}
+
+	node = PL_NODE(&pool, n);
+	if (node->frame != -1) {
+		node->flags |= REF;
+		return;
+	}
+
+	// Evicted during its test period and referenced again: it would have
+	// been a hit with more cold frames. It comes back hot.
+	if (mc < memsize)
+		mc++;
+	nghost--;
+	clockpro_remove(n);
+	pl_set_frame(&pool, n, frame);
+	node->flags = HOT;
+	nhot++;
+	clockpro_add(n);
+	clockpro_balance();
+}
+
+/* This function is called when a page is brought in without a reference
+ * (read ahead, or to fill a huge page). It comes in cold, not referenced
+ * and outside any test period, so it is evicted without a trace unless it
+ * is used first. Any ghost of the page is forgotten, as this is not a hit.
+ */
+void clockpro_insert(pgtbl_entry_t *p) {
+	int n = pl_find(&pool, p);
+
+	if (n != -1) {
+		clockpro_remove(n);
+		pl_free(&pool, n);
+		nghost--;
+	}
+	n = pl_new(&pool, p);
+	pl_set_frame(&pool, n, p->frame >> PAGE_SHIFT);
+	pl_push(&pool, &cold, n);
+	clockpro_add(n);
+}
+
+/* Initializes any data structures needed for this
+ * replacement algorithm.
+ */
+void clockpro_init() {
+	pl_pool_init(&pool, 2 * memsize + 1);
+	pl_list_init(&clk, 0);
+	pl_list_init(&cold, 1);
+	hand_hot = hand_test = -1;
+	nhot = nghost = 0;
+	mc = memsize / 2 > 0 ? memsize / 2 : 1;
+}
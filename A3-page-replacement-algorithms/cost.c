@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+
+/* Simulated time.
+ *
+ * Every reference costs cost_hit_ns for the access itself, plus cost_walk_ns
+ * if it misses in the TLB (when one is simulated). A page fault
+ * first costs cost_minor_ns to handle, then waits for the swap device to
+ * write the victim out if it is dirty, and to read the page in if it is on
+ * swap. The swap device serves one request at a time, in order: a request
+ * starts when the device is free, so write-backs that policies schedule
+ * ahead of eviction (clean_frame) do not stall the program, but delay the
+ * faults that come after them.
+ */
+
+// Costs in nanoseconds, shared by all simulations (sim -C)
+unsigned long cost_hit_ns = 100;
+unsigned long cost_minor_ns = 1000;
+unsigned long cost_swapin_ns = 100000;
+unsigned long cost_swapout_ns = 100000;
+unsigned long cost_walk_ns = 20;
+
+__thread unsigned long long sim_time;        // Simulated time so far
+static __thread unsigned long long busy_until; // When the device is free
+static __thread unsigned long long fault_start;
+
+/* Fault latencies are counted in a log-linear histogram: values below 32
+ * have a bucket each, and every power of two above is split in 16 buckets,
+ * so a percentile is exact to within 1/16.
+ */
+#define SUB_BITS 4
+#define HIST_BUCKETS (32 + (64 - 5) * 16)
+
+static __thread unsigned long hist[HIST_BUCKETS];
+static __thread unsigned long num_faults;
+static __thread unsigned long long max_latency;
+
+static int bucket(unsigned long long v) {
+	int e;
+
+	if (v < 32)
+		return v;
+	e = 63 - __builtin_clzll(v);
+	return 32 + (e - 5) * 16 + (int)((v >> (e - SUB_BITS)) - 16);
+}
+
+// Largest value that falls in bucket b.
+static unsigned long long bucket_max(int b) {
+	int e;
+
+	if (b < 32)
+		return b;
+	e = (b - 32) / 16 + 5;
+	return ((unsigned long long)(16 + (b - 32) % 16 + 1) << (e - SUB_BITS)) - 1;
+}
+
+/* Resets the clock and the latency histogram for a new simulation.
+ */
+void cost_init() {
+	sim_time = busy_until = 0;
+	memset(hist, 0, sizeof(hist));
+	num_faults = 0;
+	max_latency = 0;
+}
+
+/* Called on every reference, after its fault (if any) has been served.
+ */
+void cost_access() {
+	sim_time += cost_hit_ns;
+}
+
+void cost_walk() {
+	sim_time += cost_walk_ns;
+}
+
+void cost_fault_begin() {
+	fault_start = sim_time;
+	sim_time += cost_minor_ns;
+}
+
+void cost_fault_end() {
+	unsigned long long latency = sim_time - fault_start;
+
+	hist[bucket(latency)]++;
+	num_faults++;
+	if (latency > max_latency)
+		max_latency = latency;
+}
+
+/* Queues a request of ns on the swap device. If wait is set the program is
+ * stalled until it completes.
+ */
+static void device(unsigned long ns, int wait) {
+	unsigned long long start = sim_time > busy_until ? sim_time : busy_until;
+
+	busy_until = start + ns;
+	if (wait)
+		sim_time = busy_until;
+}
+
+void cost_swapin(int wait) {
+	device(cost_swapin_ns, wait);
+}
+
+void cost_swapout(int wait) {
+	device(cost_swapout_ns, wait);
+}
+
+/* Returns the fault latency that pct percent of the faults did not exceed,
+ * or 0 if there were no faults.
+ */
+unsigned long long fault_latency(double pct) {
+	unsigned long rank = (unsigned long)(pct / 100 * num_faults + 0.5);
+	unsigned long seen = 0;
+	int b;
+
+	if (num_faults == 0)
+		return 0;
+	if (rank < 1)
+		rank = 1;
+	for (b = 0; b < HIST_BUCKETS; b++) {
+		seen += hist[b];
+		if (seen >= rank)
+			break;
+	}
+	return bucket_max(b) < max_latency ? bucket_max(b) : max_latency;
+}
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include "sim.h"
+#include "trace.h"
+
+/* Reduces an address trace generated by the Valgrind lackey tool with the
+ * Fastslim-Demand algorithm described in "FastSlim: prefetch-safe trace
+ * reduction for I/O cache simulation" by Wei Jin, Xiaobai Sun, and Jeffrey
+ * S. Chase in ACM Transactions on Modeling and Computer Simulation, Vol. 11,
+ * No. 2 (April 2001), pages 125-160. http://doi.acm.org/10.1145/384169.384170
+ *
+ * The first access to a page is kept. Accesses to a page that is still in the
+ * trace buffer are dropped. When the buffer is full, the accesses kept so far
+ * are emitted in trace order and the buffer is emptied.
+ */
+
+#define READ_SIZE (1 << 20)   // Bytes read from the input at a time
+
+struct item {
+	char type;
+	addr_t page;
+};
+
+// The pages in the trace buffer, in an open-addressed table. A slot is in
+// use if its generation is the current one, so emptying the buffer is just
+// a new generation.
+static addr_t *slot_page;
+static unsigned *slot_gen;
+static unsigned slot_mask;
+static unsigned gen = 1;
+
+static struct item *toprint;  // Accesses kept, in trace order
+static int num_items;
+static int buffersize = 4;
+static int keepcode = 0;
+
+static FILE *outfp;
+static uint32_t out_flags;
+static int binary = 0;
+static addr_t last_page;
+static uint64_t num_refs;
+
+/*
+ * Returns 1 if page is in the trace buffer, and adds it otherwise.
+ */
+static int buffer_lookup(addr_t page) {
+	unsigned i = (unsigned)((page * 0x9e3779b97f4a7c15ULL) >> 32) &
+		slot_mask;
+
+	while (slot_gen[i] == gen) {
+		if (slot_page[i] == page)
+			return 1;
+		i = (i + 1) & slot_mask;
+	}
+	slot_gen[i] = gen;
+	slot_page[i] = page;
+	return 0;
+}
+
+/*
+ * Writes the accesses kept so far and empties the trace buffer.
+ */
+static void emit() {
+	int i;
+
+	for (i = 0; i < num_items; i++) {
+		addr_t vaddr = toprint[i].page << PAGE_SHIFT;
+
+		if (binary) {
+			trace_write_ref(outfp, out_flags, toprint[i].type, vaddr,
+					0, &last_page);
+		} else {
+			fprintf(outfp, "%c %lx\n", toprint[i].type, vaddr);
+		}
+	}
+	num_refs += num_items;
+	num_items = 0;
+	if (++gen == 0) {
+		memset(slot_gen, 0, (slot_mask + 1) * sizeof(unsigned));
+		gen = 1;
+	}
+}
+
+/*
+ * Processes one line of lackey output (without the newline), which looks
+ * like "I  04000000,3" or " L 7ff000398,8". Anything else is skipped.
+ */
+static void process_line(char *line, size_t len) {
+	char type;
+	char *end;
+	addr_t addr;
+
+	if (len < 4 || line[0] == '=')
+		return;
+
+	// The type is in one of the first two columns, the other is blank.
+	if (line[0] == ' ')
+		type = line[1];
+	else if (line[1] == ' ')
+		type = line[0];
+	else
+		return;
+	if (type != 'I' && type != 'L' && type != 'S' && type != 'M')
+		return;
+	if (type == 'I' && !keepcode)
+		return;
+
+	line[len] = '\0';
+	addr = strtoul(line + 3, &end, 16);
+	if (end == line + 3 || (*end != ',' && *end != '\0'))
+		return;
+
+	if (buffer_lookup(addr >> PAGE_SHIFT))
+		return;
+	if (num_items == buffersize) {
+		emit();
+		buffer_lookup(addr >> PAGE_SHIFT);
+	}
+	toprint[num_items].type = type;
+	toprint[num_items].page = addr >> PAGE_SHIFT;
+	num_items++;
+}
+
+/*
+ * Reads the input in large blocks and hands it over one line at a time.
+ * Lines that do not fit in a block are not lackey output and are skipped.
+ */
+static void process_input(int fd) {
+	char *buf = malloc(READ_SIZE + 1);
+	size_t have = 0;
+	int skipping = 0;
+	ssize_t n;
+
+	if (buf == NULL) {
+		perror("fastslim: failed to allocate input buffer");
+		exit(1);
+	}
+	while ((n = read(fd, buf + have, READ_SIZE - have)) != 0) {
+		char *line, *nl, *end;
+
+		if (n == -1) {
+			perror("fastslim: failed to read trace");
+			exit(1);
+		}
+		have += n;
+		end = buf + have;
+		line = buf;
+		while ((nl = memchr(line, '\n', end - line)) != NULL) {
+			if (!skipping)
+				process_line(line, nl - line);
+			skipping = 0;
+			line = nl + 1;
+		}
+		have = end - line;
+		if (have == READ_SIZE) {
+			have = 0;
+			skipping = 1;
+		} else {
+			memmove(buf, line, have);
+		}
+	}
+	if (have > 0 && !skipping)
+		process_line(buf, have);
+	free(buf);
+}
+
+int main(int argc, char *argv[]) {
+	int opt;
+	int fd = 0;
+	char *outfile = NULL;
+	unsigned slots;
+	static struct option long_opts[] = {
+		{"keepcode", no_argument, NULL, 'k'},
+		{"buffersize", required_argument, NULL, 'b'},
+		{"output", required_argument, NULL, 'o'},
+		{"delta", no_argument, NULL, 'd'},
+		{NULL, 0, NULL, 0}
+	};
+	char *usage = "USAGE: fastslim [-k] [-b buffersize] [-o outfile [-d]] "
+		"[tracefile]\n"
+		"  -k, --keepcode    include code pages in the reduced trace\n"
+		"  -b, --buffersize  number of entries in the trace buffer "
+		"(4)\n"
+		"  -o, --output      write a binary trace to outfile instead "
+		"of text to stdout\n"
+		"  -d, --delta       delta encode the binary trace\n";
+
+	while ((opt = getopt_long(argc, argv, "kb:o:d", long_opts,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'k':
+			keepcode = 1;
+			break;
+		case 'b':
+			buffersize = strtol(optarg, NULL, 10);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'd':
+			out_flags |= TRACE_DELTA;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (argc - optind > 1 || buffersize < 1 ||
+	    (out_flags != 0 && outfile == NULL)) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+
+	if (optind < argc && strcmp(argv[optind], "-") != 0) {
+		if ((fd = open(argv[optind], O_RDONLY)) == -1) {
+			perror("Error opening tracefile:");
+			exit(1);
+		}
+	}
+
+	for (slots = 2; slots < 2 * (unsigned)buffersize; slots *= 2)
+		;
+	slot_mask = slots - 1;
+	slot_page = malloc(slots * sizeof(addr_t));
+	slot_gen = calloc(slots, sizeof(unsigned));
+	toprint = malloc(buffersize * sizeof(struct item));
+	if (slot_page == NULL || slot_gen == NULL || toprint == NULL) {
+		perror("fastslim: failed to allocate trace buffer");
+		exit(1);
+	}
+
+	if (outfile != NULL) {
+		if ((outfp = fopen(outfile, "w")) == NULL) {
+			perror("Error opening output file:");
+			exit(1);
+		}
+		setvbuf(outfp, NULL, _IOFBF, READ_SIZE);
+		binary = 1;
+		// The header is rewritten with the real count at the end.
+		trace_write_header(outfp, out_flags, 0);
+	} else {
+		outfp = stdout;
+		setvbuf(outfp, NULL, _IOFBF, READ_SIZE);
+	}
+
+	process_input(fd);
+	emit();
+
+	if (binary) {
+		rewind(outfp);
+		trace_write_header(outfp, out_flags, num_refs);
+	}
+	if (fclose(outfp) != 0) {
+		perror("Error writing output file:");
+		exit(1);
+	}
+	return 0;
+}
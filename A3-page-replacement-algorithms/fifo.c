@@ -4,22 +4,17 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include "pagetable.h"
+#include "sim.h"
 
 
-extern int memsize;
-
 extern int debug;
 
-extern struct frame *coremap;
-
-typedef struct node {
-	pgtbl_entry_t *value;
-	struct node *next;
-} Node;
-
-// Front of FIFO queue.
-Node *start;
-//Node *end; not needed
+// FIFO queue of frame numbers, kept in a ring buffer with one slot per frame.
+// Frames are queued when allocate_frame hands them to a page, so the queue
+// never holds more than memsize entries.
+static __thread int *queue;
+static __thread unsigned front; // Index of the oldest frame in queue
+static __thread unsigned count; // Number of frames in queue
 
 /* Page to evict is chosen using the fifo algorithm.
  * Returns the page frame number (which is also the index in the coremap)
@@ -27,17 +22,25 @@ Node *start;
  */
 int fifo_evict() {
 
-	int retVal = 0;
+	int frame;
+	unsigned i = 0;
 
-	// Remove from front of queue.
-	if (start != NULL){
-		Node *temp = start;
-		start = start->next;
-		retVal = temp->value->frame >> PAGE_SHIFT;
-		free(temp);
+	// Remove from front of queue. Under local replacement, the oldest
+	// frame that may be taken is removed, and the frames queued before
+	// it move up one slot.
+	assert(count > 0);
+	while (!frame_evictable(queue[(front + i) % memsize])) {
+		i++;
+		assert(i < count);
+	}
+	frame = queue[(front + i) % memsize];
+	for (; i > 0; i--) {
+		queue[(front + i) % memsize] = queue[(front + i - 1) % memsize];
 	}
+	front = (front + 1) % memsize;
+	count--;
 
-	return retVal;
+	return frame;
 }
 
 /* This function is called on each access to a page to update any information
@@ -46,43 +49,31 @@ int fifo_evict() {
  */
 void fifo_ref(pgtbl_entry_t *p) {
 
-	Node *prev = NULL;
-	Node *curr = start;
-
-	// Try to find page in queue.
-/* ANNOTATION 10: Your implementation has a higher time complexity and code complexity than the solution (-1 FIFO). */
-	while (curr != NULL){
-		if (curr->value == p)
-			return;
-
-		prev = curr;
-		curr = curr->next;
-	}
-/* END ANNOTATION 10 */
-
-	// Not in linked list
-
-	// Empty list? Add to back (and front)
-	if (prev == NULL){
-		start = (Node*)malloc(sizeof(Node));
-		start->value = p;
-		start->next = NULL;
-	}
+	// Order depends only on when a page was brought in, see fifo_alloc.
+	return;
+}
 
-	// Non-empty list? Add to back.
-	else{
-		// Prev is the last element of the list
-		prev->next = (Node*)malloc(sizeof(Node));
-		prev->next->value = p;
-		prev->next->next = NULL;
-	}
+/* This function is called by allocate_frame each time a frame is given to a
+ * new page.
+ * Input: The frame number that now holds the page.
+ */
+void fifo_alloc(int frame) {
 
-	return;
+	// Add to back of queue.
+	assert(count < memsize);
+	queue[(front + count) % memsize] = frame;
+	count++;
 }
 
 /* Initialize any data structures needed for this
  * replacement algorithm
  */
 void fifo_init() {
-	start = NULL;
+	free(queue); // From an earlier simulation on this thread, if any
+	if ((queue = malloc(memsize * sizeof(int))) == NULL) {
+		perror("Failed to allocate fifo queue");
+		exit(1);
+	}
+	front = 0;
+	count = 0;
 }
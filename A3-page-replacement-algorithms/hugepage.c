@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagemap.h"
+#include "trace.h"
+
+/* Huge page accounting.
+ *
+ * A huge page is an aligned run of huge_pages base pages in a second-level
+ * page table, which one entry of a middle level would map on real hardware
+ * (512 pages, 2MB, on x86-64). A page directory entry here covers a whole
+ * second-level table, which is larger than most simulated memories, so
+ * huge pages are tracked per region rather than by the directory itself.
+ *
+ * A region that takes a fault when at least huge_promote_pct percent of its
+ * pages are resident is dense and hot: the rest of it is filled in at once
+ * (see find_physpage), and it is promoted when all its pages are resident.
+ * Evicting any page of a huge page splits it back into base pages, as
+ * reclaim does with transparent huge pages.
+ */
+
+unsigned huge_pages = 0;          // Base pages per huge page, 0 if disabled
+unsigned huge_promote_pct = 50;
+
+__thread int huge_promote_count;
+__thread int huge_split_count;
+__thread int huge_fill_count;
+__thread int huge_fill_hit_count;
+__thread int huge_fill_wasted_count;
+__thread unsigned huge_mapped;    // Huge pages mapped now
+
+// Resident pages of each region with any, plus REGION_HUGE if promoted.
+// Keys are the region number, tagged with the pid like trace records.
+static __thread struct pagemap regions;
+
+#define REGION_HUGE     (1UL << 32)
+#define REGION_COUNT(v) ((v) & (REGION_HUGE - 1))
+
+static addr_t region_key(int pid, addr_t vaddr) {
+	return ((addr_t)pid << TRACE_PID_SHIFT) |
+		((vaddr >> PAGE_SHIFT) / huge_pages);
+}
+
+void huge_init() {
+	pagemap_init(&regions, 1024);
+	huge_promote_count = huge_split_count = 0;
+	huge_fill_count = huge_fill_hit_count = huge_fill_wasted_count = 0;
+	huge_mapped = 0;
+}
+
+void huge_destroy() {
+	pagemap_destroy(&regions);
+}
+
+/* Returns true if the fault on vaddr, by the current process, should fill
+ * in the rest of its region. Regions that do not fit twice in memory are
+ * never filled.
+ */
+int huge_should_fill(addr_t vaddr) {
+	unsigned long *val = pagemap_find(&regions,
+					  region_key(cur_proc->pid, vaddr));
+	unsigned long resident = val != NULL ? REGION_COUNT(*val) : 0;
+
+	if (huge_pages > memsize / 2 || (val != NULL && (*val & REGION_HUGE)))
+		return 0;
+	return (resident + 1) * 100 >= (unsigned long)huge_promote_pct *
+		huge_pages;
+}
+
+/* Returns true if the page at vaddr of process pid is part of a huge page.
+ */
+int huge_is_mapped(int pid, addr_t vaddr) {
+	unsigned long *val = pagemap_find(&regions, region_key(pid, vaddr));
+
+	return val != NULL && (*val & REGION_HUGE);
+}
+
+/* Called when the page at vaddr of the current process is brought into
+ * memory. Promotes its region once all of it is resident.
+ */
+void huge_page_in(addr_t vaddr) {
+	unsigned long *val = pagemap_insert(&regions,
+					    region_key(cur_proc->pid, vaddr), 0);
+
+	(*val)++;
+	if (REGION_COUNT(*val) == huge_pages) {
+		*val |= REGION_HUGE;
+		huge_promote_count++;
+		huge_mapped++;
+	}
+}
+
+/* Called when the page at vaddr of process pid is evicted. Splits its
+ * region if it was a huge page.
+ */
+void huge_page_out(int pid, addr_t vaddr) {
+	addr_t key = region_key(pid, vaddr);
+	unsigned long *val = pagemap_find(&regions, key);
+
+	if (*val & REGION_HUGE) {
+		*val &= ~REGION_HUGE;
+		huge_split_count++;
+		huge_mapped--;
+	}
+	if (--(*val) == 0)
+		pagemap_remove(&regions, key);
+}
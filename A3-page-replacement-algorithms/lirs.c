@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "pagetable.h"
+#include "pagelist.h"
+#include "sim.h"
+
+
+extern int debug;
+
+/* Low Inter-reference Recency Set (Jiang and Zhang, SIGMETRICS 2002).
+ *
+ * Pages with a short reuse distance are LIR and always stay in memory. The
+ * few remaining frames hold HIR pages, which are evicted in FIFO order from
+ * the list Q. The recency stack S, ordered from bottom (oldest) to top,
+ * holds the LIR pages and the HIR pages, resident or not, that have been
+ * referenced more recently than the bottom LIR page. An HIR page that is
+ * referenced again while on S has a shorter reuse distance than the oldest
+ * LIR page, so the two swap roles.
+ *
+ * S uses the first pair of node links. Q, and the FIFO of ghosts used to
+ * bound how many evicted pages S remembers, use the second.
+ */
+#define LIR (0x1)
+
+static __thread struct pl_pool pool;
+static __thread struct pl_list s, q, ghosts;
+static __thread int nlir;        // Number of LIR pages
+static __thread int llirs;       // Frames for LIR pages
+static __thread int max_ghosts;  // Most evicted pages remembered on S
+
+/* Removes HIR pages from the bottom of S until an LIR page is there.
+ * Resident HIR pages stay on Q, evicted ones are forgotten.
+ */
+static void lirs_prune() {
+	int n;
+
+	while ((n = s.head) != -1 && !(PL_NODE(&pool, n)->flags & LIR)) {
+		pl_remove(&pool, &s, n);
+		if (PL_NODE(&pool, n)->frame == -1) {
+			pl_remove(&pool, &ghosts, n);
+			pl_free(&pool, n);
+		}
+	}
+}
+
+/* Turns the bottom LIR page on S into a resident HIR page at the end of Q.
+ */
+static void lirs_demote() {
+	int n = s.head;
+
+	assert(n != -1 && (PL_NODE(&pool, n)->flags & LIR));
+	pl_remove(&pool, &s, n);
+	PL_NODE(&pool, n)->flags &= ~LIR;
+	nlir--;
+	pl_push(&pool, &q, n);
+	lirs_prune();
+}
+
+/* Makes node n, which is on S, an LIR page on top of S.
+ */
+static void lirs_promote(int n) {
+	pl_remove(&pool, &s, n);
+	pl_push(&pool, &s, n);
+	PL_NODE(&pool, n)->flags |= LIR;
+	nlir++;
+	lirs_demote();
+}
+
+/* Page to evict is chosen using the lirs algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int lirs_evict() {
+	int n, frame;
+
+	// Only possible when nearly all frames are for LIR pages.
+	if (q.len == 0) {
+		lirs_demote();
+	}
+
+	n = q.head;
+	pl_remove(&pool, &q, n);
+	if (PL_NODE(&pool, n)->on[0] != &s) {
+		frame = PL_NODE(&pool, n)->frame;
+		pl_free(&pool, n);
+		return frame;
+	}
+
+	// Still on S, so remember it, forgetting the oldest ghost if needed.
+	frame = pl_make_ghost(&pool, n);
+	pl_push(&pool, &ghosts, n);
+	if (ghosts.len > max_ghosts) {
+		int old = ghosts.head;
+		pl_remove(&pool, &ghosts, old);
+		pl_remove(&pool, &s, old);
+		pl_free(&pool, old);
+	}
+	return frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the lirs algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void lirs_ref(pgtbl_entry_t *p) {
+	int frame = p->frame >> PAGE_SHIFT;
+	int n = pl_find(&pool, p);
+	struct pl_node *node;
+
+	if (n == -1) {
+		// No history: LIR while there are frames for LIR pages left,
+		// resident HIR after that.
+		n = pl_new(&pool, p);
+		pl_set_frame(&pool, n, frame);
+		pl_push(&pool, &s, n);
+		if (nlir < llirs) {
+			PL_NODE(&pool, n)->flags |= LIR;
+			nlir++;
+		} else {
+			pl_push(&pool, &q, n);
+			lirs_prune();
+		}
+		return;
+	}
+
+	node = PL_NODE(&pool, n);
+	if (node->frame == -1) {
+		// An evicted HIR page still on S was brought back in.
+		pl_remove(&pool, &ghosts, n);
+		pl_set_frame(&pool, n, frame);
+		lirs_promote(n);
+	} else if (node->flags & LIR) {
+		pl_remove(&pool, &s, n);
+		pl_push(&pool, &s, n);
+		lirs_prune();
+	} else if (node->on[0] == &s) {
+		// Resident HIR page on S.
+		pl_remove(&pool, &q, n);
+		lirs_promote(n);
+	} else {
+		// Resident HIR page that fell off S: stays HIR.
+		pl_push(&pool, &s, n);
+		pl_remove(&pool, &q, n);
+		pl_push(&pool, &q, n);
+		lirs_prune();
+	}
+}
+
+/* This function is called when a page is brought in without a reference
+ * (read ahead, or to fill a huge page). It becomes a resident HIR page on Q
+ * only, like one that fell off S, and any ghost of it is forgotten: it is
+ * evicted without a trace unless it is referenced first.
+ */
+void lirs_insert(pgtbl_entry_t *p) {
+	int n = pl_find(&pool, p);
+
+	if (n != -1) {
+		pl_remove(&pool, &ghosts, n);
+		pl_remove(&pool, &s, n);
+		pl_free(&pool, n);
+	}
+	n = pl_new(&pool, p);
+	pl_set_frame(&pool, n, p->frame >> PAGE_SHIFT);
+	pl_push(&pool, &q, n);
+}
+
+/* Initializes any data structures needed for this
+ * replacement algorithm.
+ */
+void lirs_init() {
+	// 1% of memory for HIR pages, as in the paper.
+	int lhirs = memsize / 100 > 0 ? memsize / 100 : 1;
+
+	llirs = memsize > lhirs ? memsize - lhirs : 0;
+	max_ghosts = memsize;
+	pl_pool_init(&pool, memsize + max_ghosts + 1);
+	pl_list_init(&s, 0);
+	pl_list_init(&q, 1);
+	pl_list_init(&ghosts, 1);
+	nlir = 0;
+}
@@ -4,22 +4,46 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include "pagetable.h"
+#include "sim.h"
 
 
-extern int memsize;
-
 extern int debug;
 
-extern struct frame *coremap;
+// The recency list is threaded through per-frame arrays of prev/next frame
+// numbers (-1 for none), so no memory is allocated per reference.
+// Head is the least recently used frame. Tail is the most recently used.
+static __thread int *prev;
+static __thread int *next;
+static __thread int head;
+static __thread int tail;
 
-typedef struct node {
-	pgtbl_entry_t *value;
-	struct node *next;
-} Node;
+/* Removes frame from the recency list. The frame must be on the list.
+ */
+static void lru_unlink(int frame) {
+	if (prev[frame] != -1)
+		next[prev[frame]] = next[frame];
+	else
+		head = next[frame];
+
+	if (next[frame] != -1)
+		prev[next[frame]] = prev[frame];
+	else
+		tail = prev[frame];
+
+	prev[frame] = next[frame] = -1;
+}
 
-// Start represents the least recently used page. End represents most recently used.
-Node *start;
-Node *end;
+/* Appends frame to the most recently used end of the recency list.
+ */
+static void lru_push(int frame) {
+	prev[frame] = tail;
+	next[frame] = -1;
+	if (tail != -1)
+		next[tail] = frame;
+	else
+		head = frame;
+	tail = frame;
+}
 
 /* Page to evict is chosen using the accurate LRU algorithm.
  * Returns the page frame number (which is also the index in the coremap)
@@ -28,17 +52,17 @@ Node *end;
 
 int lru_evict() {
 
-	int retVal = 0;
+	int frame = head;
 
-	// Evict LRU
-	if (start != NULL){
-		Node *temp = start;
-		start = start->next;
-		retVal = temp->value->frame >> PAGE_SHIFT;
-		free(temp);
-	}
+	// Evict LRU, or under local replacement the least recently used frame
+	// that may be taken. The frame is relinked when its new page is
+	// referenced.
+	while (frame != -1 && !frame_evictable(frame))
+		frame = next[frame];
+	assert(frame != -1);
+	lru_unlink(frame);
 
-	return retVal;
+	return frame;
 }
 
 /* This function is called on each access to a page to update any information
@@ -47,63 +71,50 @@ int lru_evict() {
  */
 void lru_ref(pgtbl_entry_t *p) {
 
-	Node *prev = NULL;
-	Node *curr = start;
-/* ANNOTATION 13: Your implementation has a higher time complexity and higher code complexity than the solution (-2 LRU). */
-
-	while (curr != NULL){
-
-		if (curr->value == p){
-
-			// Put to back (mru).
-			if (prev != NULL){
-				// Special case : if at the front (lru).
-				end->next = curr;
-				prev->next = curr->next;
-				curr->next = NULL;
-				end = curr;
-			}
-			// Otherwise.
-			else if (curr->next != NULL){
-				start = curr->next;
-				end->next = curr;
-				curr->next = NULL;
-				end = curr;
-			}
-			return;
-		}
-		prev = curr;
-		curr = curr->next;
-	}
-/* END ANNOTATION 13 */
-
-	// Page is not in linked list
+	int frame = p->frame >> PAGE_SHIFT;
 
-	// Empty list case
-	if (prev == NULL){
-		start = (Node*)malloc(sizeof(Node));
-		start->value = p;
-		start->next = NULL;
-		end = start;
-	}
+	// Already most recently used, nothing to do.
+	if (frame == tail)
+		return;
 
-	// Non-empty list
-	else{
-		//prev is the last element
-		prev->next = (Node*)malloc(sizeof(Node));
-		prev->next->value = p;
-		prev->next->next = NULL;
-		end = prev->next;
-	}
+	// Move to back (mru). Frames not yet on the list are just appended.
+	if (frame == head || prev[frame] != -1)
+		lru_unlink(frame);
+	lru_push(frame);
 
 	return;
 }
 
 
+/* This function is called when a page is brought in without a reference
+ * (read ahead, or to fill a huge page). LRU only knows recency, and the page
+ * is as recent as the fault that brought it in, so it goes on the most
+ * recently used end. Putting it on the other end would have each page read
+ * ahead evict the one before it.
+ */
+void lru_insert(pgtbl_entry_t *p) {
+
+	lru_push(p->frame >> PAGE_SHIFT);
+}
+
 /* Initialize any data structures needed for this
  * replacement algorithm
  */
 void lru_init() {
-	start = NULL;
-	end = NULL;
+	int i;
+
+	head = -1;
+	tail = -1;
+	free(prev);
+	free(next);
+	prev = malloc(memsize * sizeof(int));
+	next = malloc(memsize * sizeof(int));
+	if (prev == NULL || next == NULL) {
+		perror("lru: failed to allocate recency list");
+		exit(1);
+	}
+	for (i = 0; i < memsize; i++) {
+		prev[i] = -1;
+		next[i] = -1;
+	}
 }
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "pagemap.h"
+#include "trace.h"
+
+/* One-pass LRU miss ratio curves, using Mattson's stack algorithm.
+ *
+ * LRU has the inclusion property: with m frames, memory holds exactly the m
+ * most recently used pages. So a reference hits with m frames iff its stack
+ * distance (the number of distinct pages used since the last reference to
+ * the same page, counting that page) is at most m. One pass computing the
+ * distance of every reference gives the hit count for all memory sizes.
+ *
+ * The distance is counted with a Fenwick tree over reference times, holding
+ * a 1 at the time of the latest reference to each page. The distance of a
+ * reference at time t to a page last used at time s is then the number of
+ * 1s in [s, t), found in O(log n).
+ */
+
+// Fenwick tree over times 1..n (index 0 is unused).
+static unsigned *tree;
+static unsigned long tree_size;
+
+static void tree_add(unsigned long i, int val) {
+	for (; i <= tree_size; i += i & -i) {
+		tree[i] += val;
+	}
+}
+
+// Sum over times 1..i.
+static unsigned long tree_sum(unsigned long i) {
+	unsigned long sum = 0;
+	for (; i > 0; i -= i & -i) {
+		sum += tree[i];
+	}
+	return sum;
+}
+
+/*
+ * Prints the LRU hit and miss counts for every memory size from 1 up to the
+ * largest of sizes, or up to the number of distinct pages in the trace if
+ * sizes are all 0. Then prints the same summary as a normal run of sim for
+ * each nonzero size in sizes.
+ */
+void lru_curve(struct trace *t, unsigned *sizes, int num_sizes) {
+	uint64_t *recs;
+	uint64_t n, i;
+	unsigned long *hist;   // hist[d] is the number of references at distance d
+	struct pagemap last;   // Time of the latest reference to each page
+	unsigned long maxsize = 0, m, hits;
+	int j;
+
+	recs = trace_load(t, &n);
+
+	tree_size = n;
+	tree = calloc(n + 1, sizeof(unsigned));
+	hist = calloc(n + 1, sizeof(unsigned long));
+	if (tree == NULL || hist == NULL) {
+		perror("Failed to allocate stack distance tables");
+		exit(1);
+	}
+	pagemap_init(&last, 1024);
+
+	for (i = 1; i <= n; i++) {
+		addr_t page = recs[i - 1] >> 2;
+		unsigned long *prev = pagemap_insert(&last, page, 0);
+
+		// A first reference (*prev == 0) is a miss at any size.
+		if (*prev != 0) {
+			hist[tree_sum(i - 1) - tree_sum(*prev - 1)]++;
+			tree_add(*prev, -1);
+		}
+		tree_add(i, 1);
+		*prev = i;
+	}
+
+	for (j = 0; j < num_sizes; j++) {
+		if (sizes[j] > maxsize)
+			maxsize = sizes[j];
+	}
+	if (maxsize == 0)
+		maxsize = last.count;
+
+	printf("memsize,hits,misses,hit_rate,miss_rate\n");
+	hits = 0;
+	for (m = 1; m <= maxsize; m++) {
+		if (m <= n)
+			hits += hist[m];
+		printf("%lu,%lu,%lu,%.4f,%.4f\n", m, hits, n - hits,
+		       (double)hits/n * 100, (double)(n - hits)/n * 100);
+	}
+
+	for (j = 0; j < num_sizes; j++) {
+		if (sizes[j] == 0)
+			continue;
+		hits = 0;
+		for (m = 1; m <= sizes[j] && m <= n; m++) {
+			hits += hist[m];
+		}
+		printf("\n");
+		printf("Memory size: %u\n", sizes[j]);
+		printf("Hit count: %lu\n", hits);
+		printf("Miss count: %lu\n", n - hits);
+		printf("Total references : %lu\n", (unsigned long)n);
+		printf("Hit rate: %.4f\n", (double)hits/n * 100);
+		printf("Miss rate: %.4f\n", (double)(n - hits)/n * 100);
+	}
+
+	pagemap_destroy(&last);
+	free(tree);
+	free(hist);
+}
@@ -3,171 +3,216 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 #include "pagetable.h"
+#include "pagemap.h"
 #include "sim.h"
+#include "trace.h"
 
-#define NUMPAGES (PTRS_PER_PGDIR*PTRS_PER_PGTBL)
+// Position used for pages that are never referenced again.
+#define NEVER ULONG_MAX
 
-//extern int memsize;
-extern int debug;
-extern struct frame *coremap;
-
-/* A node entry in a linked list. Each one represents a memory access gotten
-from the trace file.*/
-typedef struct node {
-
-	unsigned long number; // Contains the line number in the trace file of this
-												//  memory access (eg number = 0 for first mem access)
-												// NOTE: for large enough trace files, number could
-												//			overflow.
+// In a window entry for a page, marks the frame of a page whose last
+// reference was replayed, rather than a position in the window.
+#define IN_FRAME (1UL << 63)
 
-	struct node *next_same_vaddr; // Pointer to the next node with the same page
-																// (i.e. same vaddr, perhaps with different offset)
-} Node;
-
-/* A linked list structure. Contains pointers to the front and end nodes.
- * Early memory accesses go the front of the list, later ones to the back. */
-typedef struct list {
-	Node *front;
-	Node *end;
-} List;
+extern int debug;
 
 // ============   Data structures   ============
 
-// A list for every page. For a given list array[i], each node in that list
-// represents a memory access at location vaddr, with i = vaddr >> PAGE_SHIFT.
-List *array[NUMPAGES];
-
-// Represents whether the list at index i in array is set.
-// i.e. array[i] is set iff set[i] = 1.
-char set[NUMPAGES] = {0}; // Should be zero by default, but just in case.
+// next_use[i] is the position in the trace of the next reference to the page
+// referenced at position i (positions count memory accesses, starting at 0),
+// or NEVER if there is none. It only depends on the trace, so it is built
+// once and shared by all simulations.
+static unsigned long *next_use;
+static unsigned long num_refs;
+static pthread_once_t next_use_once = PTHREAD_ONCE_INIT;
+
+// Position in the trace of the next call to opt_ref.
+static __thread unsigned long curr;
+
+// The frames are kept in a max-heap ordered by the next use of the page held
+// in each frame, so the victim is always at heap[0].
+static __thread int *heap;          // Frame numbers in heap order
+static __thread int *heap_pos;      // heap_pos[frame] is the index of frame
+                                    //  in heap, or -1 if not used yet
+static __thread unsigned long *key; // key[frame] is the next use of its page
+static __thread int heap_size;
+
+// Streaming OPT (sim -O) does not build next_use. It reads the trace itself,
+// opt_window references ahead of the replay, into a ring of window entries.
+// The next use of a page is known if it is in the window, and is NEVER
+// otherwise. Frames whose page is not in the window tie, so OPT can only
+// guess between them.
+unsigned long opt_window = 0;
+__thread int opt_ambiguous_count;
+
+struct window_ref {
+	char type;
+	int pid;
+	addr_t vaddr;
+	unsigned long next;   // Position of the next reference to the page
+};
+
+static __thread struct window_ref *window;
+static __thread unsigned long win_head;  // Position of the next reference read
+static __thread int win_eof;             // The whole trace has been read
+static __thread struct pagemap win_last; // Page to the position of its last
+                                         //  reference, or IN_FRAME | frame
+static __thread addr_t *frame_page;      // Page held by each frame
+static __thread int never_count;         // Frames whose key is NEVER
 
 //==============================================
 
 /*
-/* ANNOTATION 9: well done */
- * A helpful debug method.
-/* END ANNOTATION 9 */
+ * Returns true if frame a should be evicted before frame b. Ties only happen
+ * between pages that are never used again, and go to the lower frame.
  */
-void printMem(){
-
-	for(int i = 0; i < memsize; i++) {
-		char *mem_ptr = &physmem[i*SIMPAGESIZE];
-		addr_t *vaddr_ptr = (addr_t *)(mem_ptr + sizeof(int));
-		addr_t vaddr_index = (*vaddr_ptr) >> PAGE_SHIFT;
-
-		// Empty list, meaning there will be no calls to this page in the future.
-		if(!set[vaddr_index]) {
-			printf("[%d]: vaddr = %lu, is empty\n", i, vaddr_index);
-
-		} else{
-			printf("[%d]: vaddr = %lu, front = %lu \n",i , vaddr_index, array[vaddr_index]->front->number);
-		}
-
-	}
-	printf("\n");
+static int later(int a, int b) {
+	return key[a] > key[b] || (key[a] == key[b] && a < b);
+}
 
+static void heap_swap(int i, int j) {
+	int tmp = heap[i];
+	heap[i] = heap[j];
+	heap[j] = tmp;
+	heap_pos[heap[i]] = i;
+	heap_pos[heap[j]] = j;
 }
 
 /*
- * Helper for printArray. Debug method.
+ * Restores the heap order after the key of the frame at heap index i changed.
  */
-void printList(int index){
-	Node * curr = array[index]->front;
-
-	printf("%d : ", index);
-	while (curr != NULL){
-		printf("%lu -> ", curr->number);
-		curr = curr->next_same_vaddr;
+static void heap_fix(int i) {
+	while (i > 0 && later(heap[i], heap[(i - 1) / 2])) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	while (1) {
+		int l = 2 * i + 1, r = l + 1, big = i;
+
+		if (l < heap_size && later(heap[l], heap[big]))
+			big = l;
+		if (r < heap_size && later(heap[r], heap[big]))
+			big = r;
+		if (big == i)
+			break;
+		heap_swap(i, big);
+		i = big;
 	}
-	printf("\n");
 }
 
-/*
- * Another helpful debug method.
+/* Page to evict is chosen using the optimal (aka MIN) algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
  */
-void printArray(){
-	for (int i = 0; i < NUMPAGES; i++){
-		if (set[i]){
-			printList(i);
-		}
+int opt_evict() {
+
+	// The frame stays in the heap, its key is replaced when the new page
+	// in it is referenced.
+	assert(heap_size > 0);
+	if (window != NULL && !win_eof && key[heap[0]] == NEVER &&
+	    never_count > 1) {
+		opt_ambiguous_count++;
 	}
+	return heap[0];
 }
 
-/*
- * Insert curr into the list[vaddr_index]. curr represents the line number of
- * this memory access.
+/* Returns the page of a window entry, keyed like next_use.
  */
-void insert(unsigned vaddr_index, unsigned long curr){
+static addr_t window_page(struct window_ref *w) {
+	return (w->vaddr >> PAGE_SHIFT) | ((addr_t)w->pid << TRACE_PID_SHIFT);
+}
 
-	// Initialize the list for this vaddr_index if it hasn't been initialized yet.
-	if (!set[vaddr_index]){
-		set[vaddr_index] = 1;
+/* Sets the key of frame, keeping never_count up to date.
+ */
+static void set_key(int frame, unsigned long next) {
+	if (heap_pos[frame] != -1 && key[frame] == NEVER)
+		never_count--;
+	if (next == NEVER)
+		never_count++;
+	key[frame] = next;
+}
 
-/* ANNOTATION 5: not error check'd ( code -2 ) */
-		array[vaddr_index] = (List *)malloc(sizeof(List));
-/* END ANNOTATION 5 */
-		array[vaddr_index]->front = NULL;
-		array[vaddr_index]->end = NULL;
+/* Reads one more reference of t into the window. Its position is the next
+ * use of the last reference to the same page, which may already be in a
+ * frame.
+ */
+static void window_read(struct trace *t) {
+	struct window_ref *w = &window[win_head % opt_window];
+	unsigned long *last;
+	addr_t page;
+
+	if (!trace_next(t, &w->type, &w->vaddr)) {
+		win_eof = 1;
+		return;
 	}
+	w->pid = t->pid;
+	w->next = NEVER;
+	page = window_page(w);
 
-	List *entry = array[vaddr_index];
-
-	// Create a node for this line of the trace file.
-	Node *temp = (Node *)malloc(sizeof(Node));
-	temp->number = curr;
-	temp->next_same_vaddr = NULL;
-
-	// Add to the end of the list.
-	if (entry->front == NULL){
-		entry->front = temp;
-		entry->end = temp;
+	last = pagemap_find(&win_last, page);
+	if (last == NULL) {
+		pagemap_insert(&win_last, page, win_head);
 	} else {
-		entry->end->next_same_vaddr = temp;
-		entry->end = temp;
-	}
+		if (!(*last & IN_FRAME)) {
+			window[*last % opt_window].next = win_head;
+		} else {
+			int frame = (int)(*last & ~IN_FRAME);
 
-	// This (likely) won't happen, unless the trace file does 4 billion + memory
-	//  accesses.
-	if (++curr == 0){
-/* ANNOTATION 6: probably want to terminate here - ignoring the overflow seems unsafe */
-		fprintf(stderr, "Overflow!\n");
-/* END ANNOTATION 6 */
-		// As is, evitions wouldn't work correctly if there's overflow.
-		//  Could handle the case here, but it is unlikely so I didn't bother.
+			if (frame_page[frame] == page) {
+				set_key(frame, win_head);
+				heap_fix(heap_pos[frame]);
+			}
+		}
+		*last = win_head;
 	}
-
+	win_head++;
 }
 
-/* Page to evict is chosen using the optimal (aka MIN) algorithm.
- * Returns the page frame number (which is also the index in the coremap)
- * for the page that is to be evicted.
+/* Streaming OPT replays references from its window, instead of the replay
+ * reading them from t: fills the window and returns the oldest reference
+ * in it, which opt_ref consumes.
+ * Return: 1 with type and vaddr set (and t->pid), or 0 at the end.
  */
-int opt_evict() {
+int opt_next(struct trace *t, char *type, addr_t *vaddr) {
+	struct window_ref *w;
+
+	while (!win_eof && win_head - curr < opt_window)
+		window_read(t);
+	if (curr == win_head)
+		return 0;
+
+	w = &window[curr % opt_window];
+	*type = w->type;
+	*vaddr = w->vaddr;
+	t->pid = w->pid;
+	return 1;
+}
 
-	int frame = 0;
-	unsigned long latest = 0;
+/* opt_ref for streaming OPT: consumes the oldest reference in the window.
+ */
+static void window_ref(int frame) {
+	struct window_ref *w = &window[curr % opt_window];
+	addr_t page = window_page(w);
 
-	for(int i = 0; i < memsize; i++) {
-		char *mem_ptr = &physmem[i*SIMPAGESIZE];
-		addr_t *vaddr_ptr = (addr_t *)(mem_ptr + sizeof(int));
-		addr_t vaddr_index = (*vaddr_ptr) >> PAGE_SHIFT;
-
-		// Found a page has an empty list, meaning there will be no calls to this
-		//  page in the future.
-		if(!set[vaddr_index]) {
-			frame = i;
-			return frame;
-		}
-		// Non empty list. Find which page in coremap has the largest number value.
-		// That will be the page that won't be used for the longest period of time.
-		if (array[vaddr_index]->front->number > latest){
-			latest = array[vaddr_index]->front->number;
-			frame = i;
-		}
+	// The page that was in the frame is forgotten once it is out.
+	if (heap_pos[frame] != -1 && frame_page[frame] != page) {
+		unsigned long *last = pagemap_find(&win_last,
+						   frame_page[frame]);
 
+		if (last != NULL && *last == (IN_FRAME | frame))
+			pagemap_remove(&win_last, frame_page[frame]);
 	}
-	return frame;
+	frame_page[frame] = page;
+
+	// Without a later reference in the window, the next one found is
+	// the frame's new key.
+	if (w->next == NEVER)
+		*pagemap_find(&win_last, page) = IN_FRAME | frame;
+	set_key(frame, w->next);
+	curr++;
 }
 
 /* This function is called on each access to a page to update any information
@@ -176,76 +221,127 @@ int opt_evict() {
  */
 void opt_ref(pgtbl_entry_t *p) {
 
-	// From the pte, gets vaddr (which is stored in "physical memory").
-	// Then get the List entry from the vaddr.
-/* ANNOTATION 7: could hide this boilerplate */
-	int frameNumber = p->frame >> PAGE_SHIFT;
-	char *mem_ptr = &physmem[frameNumber*SIMPAGESIZE];
-	addr_t *vaddr_ptr = (addr_t *)(mem_ptr + sizeof(int));
-	addr_t vaddr_index = (*vaddr_ptr) >> PAGE_SHIFT;
-/* END ANNOTATION 7 */
-	List *entry = array[vaddr_index];
-
-/* ANNOTATION 8: use dedicated remove operation */
-	// Remove the first element from the list.
-	Node *temp = entry->front;
-	entry->front = entry->front->next_same_vaddr;
-	free(temp);
-
-	// Free the list if it's empty.
-	if (entry->front == NULL){
-		free(entry);
-		set[vaddr_index] = 0;
+	int frame = p->frame >> PAGE_SHIFT;
+
+	if (window != NULL) {
+		window_ref(frame);
+	} else if (curr >= num_refs) {
+		fprintf(stderr, "opt: trace has more references than in %s\n",
+			tracefile != NULL ? tracefile : "stdin");
+		exit(1);
+	} else {
+		key[frame] = next_use[curr++];
+	}
+
+	if (heap_pos[frame] == -1) {
+		heap[heap_size] = frame;
+		heap_pos[frame] = heap_size++;
 	}
+	heap_fix(heap_pos[frame]);
 	return;
-/* END ANNOTATION 8 */
 }
 
-/* Initializes any data structures needed for this
- * replacement algorithm.
+/* Builds next_use from the trace.
  */
-void opt_init() {
+static void build_next_use() {
 
-	// The current line number of the file. eviciton algorithm may not work if
-	//  there are too many lines (unsigned long can go up to four billion).
-	unsigned long curr = 0;
+	struct trace trace;
+	addr_t vaddr = 0;
+	char type;
+	unsigned long cap;
+	struct pagemap last;
+	long i;
+
+	if (trace_recs != NULL) {
+		trace_from_records(&trace, trace_recs, trace_len);
+	} else if (tracefile != NULL) {
+		trace_open(&trace, tracefile);
+	} else {
+		fprintf(stderr, "opt: a tracefile must be given with -f\n");
+		exit(1);
+	}
 
-	FILE *infp = NULL;
-	if(tracefile != NULL) {
-		if((infp = fopen(tracefile, "r")) == NULL) {
-/* ANNOTATION 2: consider annotating diagnostics with standard predefined macros such as {double underscore}FILE{double underscore}, {double underscore}LINE{double underscore} etc. */
-			perror("Error opening tracefile:");
-/* ANNOTATION 3: ~ man 3 exit.  C standard provides portable macros to signal exit status - EXIT\_{SUCCESS,FAILURE} 
- */
-/* END ANNOTATION 2 */
-			exit(1);
-/* END ANNOTATION 3 */
+	// First pass: record the page of every memory access. Binary traces
+	// know their length up front.
+	num_refs = 0;
+	cap = trace.num_refs > 0 ? trace.num_refs : 1024;
+	if ((next_use = malloc(cap * sizeof(unsigned long))) == NULL) {
+		perror("opt: failed to allocate next use array");
+		exit(1);
+	}
+	while(trace_next(&trace, &type, &vaddr)) {
+		if (num_refs == cap) {
+			cap *= 2;
+			next_use = realloc(next_use,
+					   cap * sizeof(unsigned long));
+			if (next_use == NULL) {
+				perror("opt: failed to grow next use array");
+				exit(1);
+			}
 		}
+		// Pages of different processes are different pages.
+		next_use[num_refs++] = (vaddr >> PAGE_SHIFT) |
+			((addr_t)trace.pid << TRACE_PID_SHIFT);
 	}
+	trace_close(&trace);
 
-	char buf[MAXLINE];
-	addr_t vaddr = 0;
-	char type;
+	// Backward pass: replace each page with the position of the next
+	// access to the same page, in place.
+	pagemap_init(&last, 1024);
+	for (i = (long)num_refs - 1; i >= 0; i--) {
+		addr_t page = next_use[i];
+		unsigned long *pos = pagemap_insert(&last, page, NEVER);
 
-	while(fgets(buf, MAXLINE, infp) != NULL) {
-		if(buf[0] != '=') {
-			sscanf(buf, "%c %lx", &type, &vaddr);
-
-			// Remove the offset into the pagetable.
-			unsigned page = vaddr >> PAGE_SHIFT;
+		next_use[i] = *pos;
+		*pos = i;
+	}
+	pagemap_destroy(&last);
+}
 
-			// Insert curr to this pages list.
-/* ANNOTATION 4: good abstraction */
-			insert(page, curr);
-/* END ANNOTATION 4 */
-			curr++;
+/* Initializes any data structures needed for this
+ * replacement algorithm.
+ */
+void opt_init() {
 
-/* ANNOTATION 1: unnecessary branch */
-		} else {
-			continue;
+	int i;
+
+	// Free what an earlier simulation on this thread left, if any.
+	free(heap);
+	free(heap_pos);
+	free(key);
+	free(window);
+	free(frame_page);
+	if (win_last.keys != NULL)
+		pagemap_destroy(&win_last);
+	window = NULL;
+	frame_page = NULL;
+
+	if (opt_window > 0) {
+		window = malloc(opt_window * sizeof(struct window_ref));
+		frame_page = malloc(memsize * sizeof(addr_t));
+		if (window == NULL || frame_page == NULL) {
+			perror("opt: failed to allocate lookahead window");
+			exit(1);
 		}
-/* END ANNOTATION 1 */
+		pagemap_init(&win_last, 1024);
+		win_head = 0;
+		win_eof = 0;
+		never_count = 0;
+		opt_ambiguous_count = 0;
+	} else {
+		pthread_once(&next_use_once, build_next_use);
 	}
-	fclose(infp);
 
+	heap = malloc(memsize * sizeof(int));
+	heap_pos = malloc(memsize * sizeof(int));
+	key = malloc(memsize * sizeof(unsigned long));
+	if (heap == NULL || heap_pos == NULL || key == NULL) {
+		perror("opt: failed to allocate frame heap");
+		exit(1);
+	}
+	for (i = 0; i < memsize; i++) {
+		heap_pos[i] = -1;
+	}
+	heap_size = 0;
+	curr = 0;
 }
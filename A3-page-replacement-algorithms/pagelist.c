@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "sim.h"
+#include "pagelist.h"
+
+/* Sets up a pool of size nodes for a simulation with memsize frames.
+ * Frees the pool's previous memory first, so it can be called again for
+ * the next simulation on the same thread.
+ */
+void pl_pool_init(struct pl_pool *pool, int size) {
+	int i;
+
+	pl_pool_destroy(pool);
+	pool->nodes = malloc(size * sizeof(struct pl_node));
+	pool->by_frame = malloc(memsize * sizeof(int));
+	if (pool->nodes == NULL || pool->by_frame == NULL) {
+		perror("Failed to allocate page list nodes");
+		exit(1);
+	}
+	pool->size = size;
+	for (i = 0; i < size; i++) {
+		pool->nodes[i].next[0] = i + 1 < size ? i + 1 : -1;
+	}
+	pool->free_head = size > 0 ? 0 : -1;
+	for (i = 0; i < memsize; i++) {
+		pool->by_frame[i] = -1;
+	}
+	pagemap_init(&pool->ghosts, size);
+}
+
+void pl_pool_destroy(struct pl_pool *pool) {
+	if (pool->nodes == NULL)
+		return;
+	free(pool->nodes);
+	free(pool->by_frame);
+	pagemap_destroy(&pool->ghosts);
+	pool->nodes = NULL;
+	pool->by_frame = NULL;
+}
+
+/* Returns a new node for pte, not resident and on no list. Exits if the
+ * pool is empty: algorithms size their pool for the most pages they track.
+ */
+int pl_new(struct pl_pool *pool, pgtbl_entry_t *pte) {
+	int n = pool->free_head;
+	struct pl_node *node;
+
+	if (n == -1) {
+		fprintf(stderr, "page list: out of nodes\n");
+		exit(1);
+	}
+	node = PL_NODE(pool, n);
+	pool->free_head = node->next[0];
+
+	node->pte = pte;
+	node->frame = -1;
+	node->prev[0] = node->next[0] = node->prev[1] = node->next[1] = -1;
+	node->on[0] = node->on[1] = NULL;
+	node->flags = 0;
+	return n;
+}
+
+/* Forgets a node. It must not be on any list.
+ */
+void pl_free(struct pl_pool *pool, int n) {
+	struct pl_node *node = PL_NODE(pool, n);
+
+	assert(node->on[0] == NULL && node->on[1] == NULL);
+	if (node->frame != -1) {
+		pool->by_frame[node->frame] = -1;
+	} else {
+		pagemap_remove(&pool->ghosts, (addr_t)node->pte);
+	}
+	node->next[0] = pool->free_head;
+	pool->free_head = n;
+}
+
+/* Returns the node for the page with entry pte, or -1 if the page is not
+ * known. A page that was just brought into a frame is not known until
+ * pl_set_frame is called for it.
+ */
+int pl_find(struct pl_pool *pool, pgtbl_entry_t *pte) {
+	int n = pool->by_frame[pte->frame >> PAGE_SHIFT];
+	unsigned long *ghost;
+
+	if (n != -1 && PL_NODE(pool, n)->pte == pte)
+		return n;
+	ghost = pagemap_find(&pool->ghosts, (addr_t)pte);
+	return ghost != NULL ? (int)*ghost : -1;
+}
+
+/* Records that the page of node n is now resident in frame.
+ */
+void pl_set_frame(struct pl_pool *pool, int n, int frame) {
+	struct pl_node *node = PL_NODE(pool, n);
+
+	if (node->frame == -1) {
+		pagemap_remove(&pool->ghosts, (addr_t)node->pte);
+	}
+	node->frame = frame;
+	pool->by_frame[frame] = n;
+}
+
+/* Records that the page of node n is being evicted, but keep its node as
+ * a ghost. Returns the frame it was in.
+ */
+int pl_make_ghost(struct pl_pool *pool, int n) {
+	struct pl_node *node = PL_NODE(pool, n);
+	int frame = node->frame;
+
+	assert(frame != -1);
+	pool->by_frame[frame] = -1;
+	node->frame = -1;
+	pagemap_insert(&pool->ghosts, (addr_t)node->pte, n);
+	return frame;
+}
+
+void pl_list_init(struct pl_list *l, int link) {
+	l->head = l->tail = -1;
+	l->len = 0;
+	l->link = link;
+}
+
+/* Appends node n at the newest end of l.
+ */
+void pl_push(struct pl_pool *pool, struct pl_list *l, int n) {
+	pl_insert_before(pool, l, n, -1);
+}
+
+/* Inserts node n into l just before node before, or at the newest end if
+ * before is -1.
+ */
+void pl_insert_before(struct pl_pool *pool, struct pl_list *l, int n,
+		      int before) {
+	struct pl_node *node = PL_NODE(pool, n);
+	int k = l->link;
+	int prev = before == -1 ? l->tail : PL_NODE(pool, before)->prev[k];
+
+	assert(node->on[k] == NULL);
+	node->prev[k] = prev;
+	node->next[k] = before;
+	node->on[k] = l;
+	if (prev != -1)
+		PL_NODE(pool, prev)->next[k] = n;
+	else
+		l->head = n;
+	if (before != -1)
+		PL_NODE(pool, before)->prev[k] = n;
+	else
+		l->tail = n;
+	l->len++;
+}
+
+void pl_remove(struct pl_pool *pool, struct pl_list *l, int n) {
+	struct pl_node *node = PL_NODE(pool, n);
+	int k = l->link;
+
+	assert(node->on[k] == l);
+	if (node->prev[k] != -1)
+		PL_NODE(pool, node->prev[k])->next[k] = node->next[k];
+	else
+		l->head = node->next[k];
+	if (node->next[k] != -1)
+		PL_NODE(pool, node->next[k])->prev[k] = node->prev[k];
+	else
+		l->tail = node->prev[k];
+	node->prev[k] = node->next[k] = -1;
+	node->on[k] = NULL;
+	l->len--;
+}
+
+/* Returns the node after n in l, wrapping around from the newest end to
+ * the oldest, for algorithms that treat a list as a clock.
+ */
+int pl_next(struct pl_pool *pool, struct pl_list *l, int n) {
+	int next = PL_NODE(pool, n)->next[l->link];
+	return next != -1 ? next : l->head;
+}
@@ -0,0 +1,61 @@
+#ifndef __PAGELIST_H__
+#define __PAGELIST_H__
+
+#include "pagetable.h"
+#include "pagemap.h"
+
+/* Lists of pages for the replacement algorithms that keep history about
+ * more pages than fit in memory (ARC, 2Q, LIRS, CLOCK-Pro).
+ *
+ * Each page the algorithm knows about has a node from a fixed pool. While
+ * the page is resident its node is found by frame, and once it is evicted
+ * (a "ghost") by its page table entry, which stays put for the whole
+ * simulation. A node has two sets of links, so it can be on two lists at
+ * once, and all list operations are O(1).
+ */
+struct pl_list;
+
+struct pl_node {
+	pgtbl_entry_t *pte;     // Page this node is about
+	int frame;              // Frame holding the page, or -1 for a ghost
+	int prev[2];            // Links, one pair per list the node can be on
+	int next[2];
+	struct pl_list *on[2];  // List on each pair of links, or NULL
+	unsigned flags;         // For the algorithm's own use
+};
+
+struct pl_list {
+	int head;               // Oldest node (least recently added/used)
+	int tail;               // Newest node
+	int len;
+	int link;               // Which pair of node links this list uses
+};
+
+struct pl_pool {
+	struct pl_node *nodes;
+	int size;
+	int free_head;          // Unused nodes, chained through next[0]
+	int *by_frame;          // Node of the page in each frame, or -1
+	struct pagemap ghosts;  // Node of each ghost, by pte
+};
+
+extern void pl_pool_init(struct pl_pool *pool, int size);
+extern void pl_pool_destroy(struct pl_pool *pool);
+
+extern int pl_new(struct pl_pool *pool, pgtbl_entry_t *pte);
+extern void pl_free(struct pl_pool *pool, int n);
+extern int pl_find(struct pl_pool *pool, pgtbl_entry_t *pte);
+extern void pl_set_frame(struct pl_pool *pool, int n, int frame);
+extern int pl_make_ghost(struct pl_pool *pool, int n);
+
+extern void pl_list_init(struct pl_list *l, int link);
+extern void pl_push(struct pl_pool *pool, struct pl_list *l, int n);
+extern void pl_insert_before(struct pl_pool *pool, struct pl_list *l, int n,
+			     int before);
+extern void pl_remove(struct pl_pool *pool, struct pl_list *l, int n);
+extern int pl_next(struct pl_pool *pool, struct pl_list *l, int n);
+
+// Access to a node by index
+#define PL_NODE(pool, n) (&(pool)->nodes[n])
+
+#endif /* __PAGELIST_H__ */
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "pagemap.h"
+
+static size_t pagemap_hash(addr_t page, size_t size) {
+	// Fibonacci hashing spreads sequential page numbers across the table.
+	return (size_t)((page * 0x9E3779B97F4A7C15UL) >> 20) & (size - 1);
+}
+
+static void pagemap_alloc(struct pagemap *m, size_t size) {
+	size_t i;
+
+	m->keys = malloc(size * sizeof(addr_t));
+	m->vals = malloc(size * sizeof(unsigned long));
+	if (m->keys == NULL || m->vals == NULL) {
+		perror("Failed to allocate page map");
+		exit(1);
+	}
+	for (i = 0; i < size; i++) {
+		m->keys[i] = PAGEMAP_EMPTY;
+	}
+	m->size = size;
+	m->count = 0;
+}
+
+/* Initializes an empty map with room for at least size pages before it
+ * has to grow.
+ */
+void pagemap_init(struct pagemap *m, size_t size) {
+	size_t n = 16;
+
+	while (n < 2 * size) {
+		n <<= 1;
+	}
+	pagemap_alloc(m, n);
+}
+
+void pagemap_destroy(struct pagemap *m) {
+	free(m->keys);
+	free(m->vals);
+	m->keys = NULL;
+	m->vals = NULL;
+	m->size = m->count = 0;
+}
+
+/* Returns a pointer to the value stored for page, or NULL if page is not
+ * in the map. The pointer is only valid until the next insert.
+ */
+unsigned long *pagemap_find(struct pagemap *m, addr_t page) {
+	size_t i = pagemap_hash(page, m->size);
+
+	while (m->keys[i] != PAGEMAP_EMPTY) {
+		if (m->keys[i] == page)
+			return &m->vals[i];
+		i = (i + 1) & (m->size - 1);
+	}
+	return NULL;
+}
+
+/* Returns a pointer to the value stored for page, adding page with value
+ * val first if it is not in the map yet. The pointer is only valid until
+ * the next insert.
+ */
+unsigned long *pagemap_insert(struct pagemap *m, addr_t page,
+			      unsigned long val) {
+	size_t i;
+
+	// Keep the load factor under 1/2 so probe sequences stay short.
+	if (2 * (m->count + 1) > m->size) {
+		struct pagemap old = *m;
+
+		pagemap_alloc(m, 2 * old.size);
+		for (i = 0; i < old.size; i++) {
+			if (old.keys[i] != PAGEMAP_EMPTY)
+				pagemap_insert(m, old.keys[i], old.vals[i]);
+		}
+		pagemap_destroy(&old);
+	}
+
+	i = pagemap_hash(page, m->size);
+	while (m->keys[i] != PAGEMAP_EMPTY) {
+		if (m->keys[i] == page)
+			return &m->vals[i];
+		i = (i + 1) & (m->size - 1);
+	}
+	m->keys[i] = page;
+	m->vals[i] = val;
+	m->count++;
+	return &m->vals[i];
+}
+
+/* Removes page from the map, if it is there.
+ */
+void pagemap_remove(struct pagemap *m, addr_t page) {
+	size_t mask = m->size - 1;
+	size_t i = pagemap_hash(page, m->size);
+	size_t j, home;
+
+	while (m->keys[i] != page) {
+		if (m->keys[i] == PAGEMAP_EMPTY)
+			return;
+		i = (i + 1) & mask;
+	}
+
+	// Shift later entries of the probe sequence back into the hole, so
+	// lookups never stop early at an empty slot.
+	j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (m->keys[j] == PAGEMAP_EMPTY)
+			break;
+		home = pagemap_hash(m->keys[j], m->size);
+		// Entry j can move to i unless its home lies cyclically in (i, j].
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			m->keys[i] = m->keys[j];
+			m->vals[i] = m->vals[j];
+			i = j;
+		}
+	}
+	m->keys[i] = PAGEMAP_EMPTY;
+	m->count--;
+}
@@ -0,0 +1,26 @@
+#ifndef __PAGEMAP_H__
+#define __PAGEMAP_H__
+
+#include "pagetable.h"
+
+/* An open-addressed hash table from virtual page number to an unsigned long.
+ * Used by algorithms that need per-page information for pages that are not
+ * (or not yet) in the page table.
+ */
+struct pagemap {
+	addr_t *keys;          // Virtual page numbers, PAGEMAP_EMPTY if unused
+	unsigned long *vals;   // Value stored for keys[i]
+	size_t size;           // Number of slots, always a power of 2
+	size_t count;          // Number of slots in use
+};
+
+#define PAGEMAP_EMPTY ((addr_t)-1)
+
+extern void pagemap_init(struct pagemap *m, size_t size);
+extern void pagemap_destroy(struct pagemap *m);
+extern unsigned long *pagemap_find(struct pagemap *m, addr_t page);
+extern unsigned long *pagemap_insert(struct pagemap *m, addr_t page,
+				     unsigned long val);
+extern void pagemap_remove(struct pagemap *m, addr_t page);
+
+#endif /* __PAGEMAP_H__ */
@@ -1,18 +1,235 @@
 #include <assert.h>
 #include <string.h>
+#include <sys/mman.h>
 #include "sim.h"
 #include "pagetable.h"
-
-// The top-level page table (also known as the 'page directory')
-pgdir_entry_t pgdir[PTRS_PER_PGDIR];
+#include "stats.h"
+
+#ifdef FLAT_PAGETABLE
+// All page table entries of the current process, indexed by virtual page
+// number
+__thread pgtbl_entry_t *flat_pgtbl;
+#else
+// The top-level page table (also known as the 'page directory') of the
+// current process
+__thread pgdir_entry_t *pgdir;
+#endif
+
+// Simulated processes, in the order they first appear in the trace
+__thread struct process *procs = NULL;
+__thread int num_procs = 0;
+static __thread int procs_cap = 0;
+__thread struct process *cur_proc = NULL;
+
+// Which frames evict_fcn may choose, see pagetable.h
+__thread int evict_from = EVICT_ANY;
+
+// Working set window, stored in the coremap for every resident page
+// referenced in it. Windows are numbered from 1, so a page that was just
+// brought in (window 0) is not in the current one. The number would only
+// come round again after 2^32 windows, more than there are references in a
+// trace. Only resident pages are stamped, so a page that is evicted and
+// faulted back in during a window counts twice in that window's working
+// set.
+static __thread unsigned ws_window;
 
 // Counters for various events.
 // Your code must increment these when the related events occur.
-int hit_count = 0;
-int miss_count = 0;
-int ref_count = 0;
-int evict_clean_count = 0;
-int evict_dirty_count = 0;
+__thread int hit_count = 0;
+__thread int miss_count = 0;
+__thread int ref_count = 0;
+__thread int evict_clean_count = 0;
+__thread int evict_dirty_count = 0;
+__thread int writeback_count = 0;     // Dirty pages cleaned before eviction
+__thread int prefetch_count = 0;
+__thread int prefetch_hit_count = 0;
+__thread int prefetch_wasted_count = 0;
+
+// Frames are never freed during a simulation, so they are handed out in
+// order and every frame below this one is in use.
+static __thread unsigned next_free_frame = 0;
+
+// The page allocate_frame is finding a frame for, see sim.h
+__thread pgtbl_entry_t *incoming_pte = NULL;
+
+/*
+ * Writes the page in frame to swap and records in its page table entry
+ * where it went. A page that is already on swap is rewritten in place.
+ */
+static void page_out(int frame) {
+	pgtbl_entry_t *p = coremap.pte[frame];
+
+	// Where will this frame's contents be written in swap? If at all?
+	int where = INVALID_SWAP;
+
+	// Rewrites to same swap location if already on swap.
+	if (p->frame & PG_ONSWAP)
+		where = p->swap_slot;
+
+	// Will soon be on swap.
+	p->frame |= PG_ONSWAP;
+
+	int to = swap_pageout(frame, where);
+
+	// This shouldn't happen if swap size is sufficient.
+	if (to == INVALID_SWAP){
+		printf("Insufficient swap size\n");
+
+		// Don't save if you don't have the space.
+		p->frame &= ~PG_ONSWAP;
+	}
+	p->swap_slot = to;
+}
+
+/*
+ * Writes the dirty page in frame back to swap without evicting it, so that
+ * it can later be evicted clean. Used by policies that schedule write-backs
+ * ahead of eviction (see wsclock.c).
+ */
+void clean_frame(int frame) {
+	pgtbl_entry_t *p = coremap.pte[frame];
+
+	assert(p->frame & PG_VALID);
+	assert(p->frame & PG_DIRTY);
+	page_out(frame);
+	cost_swapout(0);
+
+	// Memory and swap now match, unless there was no room on swap.
+	if (p->frame & PG_ONSWAP) {
+		p->frame &= ~PG_DIRTY;
+		writeback_count++;
+	}
+}
+
+/*
+ * The page cleaner stands in for a daemon that writes dirty pages back in
+ * the background. It runs every cleaner_period references and cleans every
+ * dirty page that was not referenced since it last ran: those are the pages
+ * most likely to be evicted next, whatever the replacement algorithm, and
+ * once clean they are evicted without a write on the fault path.
+ */
+static void page_cleaner() {
+	unsigned i;
+
+	for (i = 0; i < next_free_frame; i++) {
+		pgtbl_entry_t *p = coremap.pte[i];
+
+		if ((p->frame & PG_DIRTY) &&
+		    ref_count - coremap.last_ref[i] >= cleaner_period)
+			clean_frame(i);
+	}
+}
+
+/*
+ * Returns the virtual address of the page in frame.
+ */
+static addr_t frame_vaddr(int frame) {
+	return coremap.page[frame] << PAGE_SHIFT;
+}
+
+/*
+ * Returns the fewest frames process proc should get: its working set, and
+ * at least one frame if it is active (it holds pages or made references).
+ */
+static unsigned ws_floor(struct process *proc) {
+	if (proc->ws > 0)
+		return proc->ws;
+	return proc->resident > 0 ? 1 : 0;
+}
+
+/*
+ * Ends a working set window. The working set of each process is the set of
+ * pages it referenced in the window. Each active process gets the frames
+ * its working set needs, and the frames left over are shared out in
+ * proportion to working set sizes (evenly if nobody made references). If
+ * working sets do not fit, they are all scaled down, but no active process
+ * gets less than one frame.
+ */
+static void ws_end_window() {
+	unsigned long total = 0, floors = 0;
+	int i, active = 0;
+
+	for (i = 0; i < num_procs; i++) {
+		procs[i].ws = procs[i].ws_refs;
+		procs[i].ws_refs = 0;
+		total += procs[i].ws;
+		floors += ws_floor(&procs[i]);
+		active += ws_floor(&procs[i]) > 0;
+	}
+	for (i = 0; i < num_procs; i++) {
+		unsigned floor = ws_floor(&procs[i]);
+
+		if (floor == 0) {
+			procs[i].quota = 0;
+		} else if (floors <= memsize) {
+			unsigned long spare = memsize - floors;
+
+			procs[i].quota = floor + (total > 0 ?
+				spare * procs[i].ws / total : spare / active);
+		} else {
+			procs[i].quota = (unsigned)((unsigned long)memsize *
+						    floor / floors);
+			if (procs[i].quota == 0)
+				procs[i].quota = 1;
+		}
+	}
+	ws_window++;
+}
+
+/*
+ * Raises the quota of the current process to want frames, and lowers the
+ * quotas of the other processes by as much, but not below the pages they
+ * have used in this window (and one frame if they hold any). Quotas are
+ * soft: if the others have nothing to give, they add up to more than
+ * memsize for the rest of the window, and the processes over quota give
+ * frames up as others fault. Frames in use never exceed memsize.
+ */
+static void raise_quota(unsigned want) {
+	unsigned need = want - cur_proc->quota;
+	int i;
+
+	cur_proc->quota = want;
+	for (i = 0; i < num_procs && need > 0; i++) {
+		unsigned floor = procs[i].ws_refs;
+		unsigned give;
+
+		if (&procs[i] == cur_proc)
+			continue;
+		if (floor == 0 && procs[i].resident > 0)
+			floor = 1;
+		if (procs[i].quota <= floor)
+			continue;
+		give = procs[i].quota - floor < need ?
+			procs[i].quota - floor : need;
+		procs[i].quota -= give;
+		need -= give;
+	}
+}
+
+/*
+ * Sets evict_from for a fault of the current process under local
+ * replacement: it replaces its own pages once it holds its quota, and
+ * otherwise takes frames from processes over theirs.
+ */
+static void local_victims() {
+	int i;
+
+	// Quotas come from the last window. A process is entitled to at least
+	// the pages it has used in this one, and the page it faults on.
+	if (cur_proc->quota < cur_proc->ws_refs + 1)
+		raise_quota(cur_proc->ws_refs + 1);
+	if (cur_proc->resident > 0 && cur_proc->resident >= cur_proc->quota) {
+		evict_from = cur_proc - procs;
+		return;
+	}
+	for (i = 0; i < num_procs; i++) {
+		if (procs[i].resident > procs[i].quota) {
+			evict_from = EVICT_OVER_QUOTA;
+			return;
+		}
+	}
+	evict_from = EVICT_ANY;
+}
 
 /*
  * Allocates a frame to be used for the virtual page represented by p.
@@ -23,82 +240,209 @@ int evict_dirty_count = 0;
  *
  * Counters for evictions should be updated appropriately in this function.
  */
-int allocate_frame(pgtbl_entry_t *p) {
-	int i;
+int allocate_frame(pgtbl_entry_t *p, addr_t vaddr) {
 	int frame = -1;
-	for(i = 0; i < memsize; i++) {
-		if(!coremap[i].in_use) {
-			frame = i;
-			break;
-		}
+	if(next_free_frame < memsize) {
+		frame = next_free_frame++;
+		assert(!FRAME_IN_USE(frame));
 	}
 	if(frame == -1) { // Didn't find a free page.
 		// Call replacement algorithm's evict function to select victim
 
+		incoming_pte = p;
+		if (local_window > 0)
+			local_victims();
+		STATS_START(start);
 		frame = evict_fcn();
+		STATS_STOP(PHASE_EVICT, start);
+		assert(frame_evictable(frame));
+		procs[coremap.proc[frame]].resident--;
 
 		// All frames were in use, so victim frame must hold some page
 		// Write victim page to swap, if needed, and update pagetable
 
-		coremap[frame].pte->frame &= ~PG_VALID;
-
-		// Where will this frame's contents be written in swap? If at all?
-		int where = INVALID_SWAP;
+		coremap.pte[frame]->frame &= ~PG_VALID;
+		if (coremap.pte[frame]->frame & PG_PREFETCH) {
+			coremap.pte[frame]->frame &= ~PG_PREFETCH;
+			prefetch_wasted_count++;
+		}
+		if (coremap.pte[frame]->frame & PG_HUGEFILL) {
+			coremap.pte[frame]->frame &= ~PG_HUGEFILL;
+			huge_fill_wasted_count++;
+		}
+		if (huge_pages > 0)
+			huge_page_out(procs[coremap.proc[frame]].pid,
+				      frame_vaddr(frame));
+		if (tlb_entries > 0)
+			tlb_invalidate(procs[coremap.proc[frame]].pid,
+				       frame_vaddr(frame));
 
 		// Have to save to swap if modified.
-		if (coremap[frame].pte->frame & PG_DIRTY){
+		if (coremap.pte[frame]->frame & PG_DIRTY){
 			evict_dirty_count++;
-
-			// Rewrites to same swap location if already on swap.
-			if (coremap[frame].pte->frame & PG_ONSWAP)
-				where = coremap[frame].pte->swap_off;
-
-			// Will soon be on swap, and is invalid.
-			coremap[frame].pte->frame |= PG_ONSWAP;
-
-			int to = swap_pageout(frame, where);
-
-			// This shouldn't happen if swap size is sufficient.
-			if (to == INVALID_SWAP){
-				printf("Insufficient swap size\n");
-
-				// Don't save if you don't have the space.
-				coremap[frame].pte->swap_off = INVALID_SWAP;
-				coremap[frame].pte->frame &= ~PG_ONSWAP;
-			}
-			coremap[frame].pte->swap_off = to;
-
+			page_out(frame);
+			cost_swapout(1);
 		} else {
 			evict_clean_count++;
 		}
 	}
 
 	// Record information for virtual page that will now be stored in frame
-	coremap[frame].in_use = 1;
-	coremap[frame].pte = p;
+	coremap.in_use[frame / 64] |= 1ULL << (frame % 64);
+	coremap.pte[frame] = p;
+	coremap.page[frame] = vaddr >> PAGE_SHIFT;
+	coremap.proc[frame] = cur_proc - procs;
+	coremap.ws_window[frame] = 0;
+	cur_proc->resident++;
+
+	// Let the replacement algorithm know, if it tracks allocation order
+	if (alloc_fcn != NULL)
+		alloc_fcn(frame);
 
 	return frame;
 }
 
 /*
- * Initializes the top-level pagetable.
+ * Makes pid the process whose references are simulated, creating it (with
+ * an empty page table) the first time it is seen. There are few processes,
+ * and they are looked up only when the trace switches between them.
+ */
+void set_process(int pid) {
+	struct process *proc;
+	int i;
+
+	for (i = 0; i < num_procs; i++) {
+		if (procs[i].pid == pid)
+			break;
+	}
+	if (i == num_procs) {
+		if (num_procs == procs_cap) {
+			procs_cap = procs_cap > 0 ? procs_cap * 2 : 4;
+			procs = realloc(procs, procs_cap * sizeof(struct process));
+			if (procs == NULL) {
+				perror("Failed to allocate process table");
+				exit(1);
+			}
+		}
+		proc = &procs[num_procs++];
+		memset(proc, 0, sizeof(*proc));
+		proc->pid = pid;
+		proc->quota = memsize;
+#ifdef FLAT_PAGETABLE
+		// Anonymous memory is zero-filled on first touch, so every
+		// entry starts out invalid and not on swap. swap_slot is only
+		// read when PG_ONSWAP is set, so it does not need to be
+		// INVALID_SWAP.
+		proc->pgtbl = mmap(NULL, NUM_VPAGES * sizeof(pgtbl_entry_t),
+				   PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				   -1, 0);
+		if (proc->pgtbl == MAP_FAILED) {
+			perror("Failed to reserve flat page table");
+			exit(1);
+		}
+		STATS_INC(pgtbl_allocs);
+#else
+		// All entries start at 0, which ensures valid bits are all 0.
+		proc->pgdir = calloc(PTRS_PER_PGDIR, sizeof(pgdir_entry_t));
+		if (proc->pgdir == NULL) {
+			perror("Failed to allocate page directory");
+			exit(1);
+		}
+#endif
+	}
+	cur_proc = &procs[i];
+#ifdef FLAT_PAGETABLE
+	flat_pgtbl = cur_proc->pgtbl;
+#else
+	pgdir = cur_proc->pgdir;
+#endif
+}
+
+/*
+ * Initializes the process table, with process 0 (the only one in traces
+ * without process ids) as the current process.
  * This function is called once at the start of the simulation.
- * For the simulation, there is a single "process" whose reference trace is
- * being simulated, so there is just one top-level page table (page directory).
- * To keep things simple, we use a global array of 'page directory entries'.
- *
- * In a real OS, each process would have its own page directory, which would
- * need to be allocated and initialized as part of process creation.
+ * Each process gets its own top-level page table (page directory), which
+ * is allocated when the process first appears, as part of process creation.
  */
 void init_pagetable() {
+	num_procs = 0;
+	set_process(0);
+	evict_from = EVICT_ANY;
+	ws_window = 1;
+
+	// Counters start over with each page directory
+	hit_count = miss_count = ref_count = 0;
+	evict_clean_count = evict_dirty_count = writeback_count = 0;
+	prefetch_count = prefetch_hit_count = prefetch_wasted_count = 0;
+	next_free_frame = 0;
+	cost_init();
+	if (huge_pages > 0)
+		huge_init();
+	if (tlb_entries > 0)
+		tlb_init();
+}
+
+/*
+ * Allocates the coremap for memsize frames, all free.
+ */
+void init_coremap() {
+	coremap.in_use = calloc((memsize + 63) / 64, sizeof(uint64_t));
+	coremap.pte = calloc(memsize, sizeof(pgtbl_entry_t *));
+	coremap.page = calloc(memsize, sizeof(addr_t));
+	coremap.proc = calloc(memsize, sizeof(int));
+	coremap.last_ref = calloc(memsize, sizeof(unsigned));
+	coremap.ws_window = calloc(memsize, sizeof(unsigned));
+	if (coremap.in_use == NULL || coremap.pte == NULL ||
+	    coremap.page == NULL || coremap.proc == NULL ||
+	    coremap.last_ref == NULL || coremap.ws_window == NULL) {
+		perror("Failed to allocate coremap");
+		exit(1);
+	}
+}
+
+void destroy_coremap() {
+	free(coremap.in_use);
+	free(coremap.pte);
+	free(coremap.page);
+	free(coremap.proc);
+	free(coremap.last_ref);
+	free(coremap.ws_window);
+	memset(&coremap, 0, sizeof(coremap));
+}
+
+/*
+ * Frees the page tables of all processes, at the end of a simulation.
+ */
+void destroy_pagetable() {
 	int i;
-	// Set all entries in top-level pagetable to 0, which ensures valid
-	// bits are all 0 initially.
-	for (i=0; i < PTRS_PER_PGDIR; i++) {
-		pgdir[i].pde = 0;
+
+	for (i = 0; i < num_procs; i++) {
+#ifdef FLAT_PAGETABLE
+		munmap(procs[i].pgtbl, NUM_VPAGES * sizeof(pgtbl_entry_t));
+#else
+		int j;
+		for (j=0; j < PTRS_PER_PGDIR; j++) {
+			if (procs[i].pgdir[j].pde & PG_VALID) {
+				free((pgtbl_entry_t *)(procs[i].pgdir[j].pde &
+						       PAGE_MASK));
+			}
+		}
+		free(procs[i].pgdir);
+#endif
 	}
+	free(procs);
+	procs = NULL;
+	if (huge_pages > 0)
+		huge_destroy();
+	if (tlb_entries > 0)
+		tlb_destroy();
+	num_procs = procs_cap = 0;
+	cur_proc = NULL;
 }
 
+#ifndef FLAT_PAGETABLE
 // For simulation, we get second-level pagetables from ordinary memory
 pgdir_entry_t init_second_level() {
 	int i;
@@ -113,10 +457,12 @@ pgdir_entry_t init_second_level() {
 		exit(1);
 	}
 
+	STATS_INC(pgtbl_allocs);
+
 	// Initialize all entries in second-level pagetable
 	for (i=0; i < PTRS_PER_PGTBL; i++) {
 		pgtbl[i].frame = 0; // sets all bits, including valid, to zero
-		pgtbl[i].swap_off = INVALID_SWAP;
+		pgtbl[i].swap_slot = INVALID_SWAP;
 	}
 
 	// Mark the new page directory entry as valid
@@ -124,6 +470,7 @@ pgdir_entry_t init_second_level() {
 
 	return new_entry;
 }
+#endif
 
 /*
  * Initializes the content of a (simulated) physical memory frame when it
@@ -146,6 +493,104 @@ void init_frame(int frame, addr_t vaddr) {
 	return;
 }
 
+/*
+ * Returns the page table entry for vaddr, creating its second-level page
+ * table if needed.
+ */
+static pgtbl_entry_t *lookup_pte(addr_t vaddr) {
+#ifdef FLAT_PAGETABLE
+	// Same layout as the two-level table, without the pointer chase
+	return &flat_pgtbl[PGDIR_INDEX(vaddr) * PTRS_PER_PGTBL + PGTBL_INDEX(vaddr)];
+#else
+	unsigned idx = PGDIR_INDEX(vaddr); // get index into page directory
+
+	// Use top-level page directory to get pointer to 2nd-level page table
+	int valid = pgdir[idx].pde & PG_VALID;
+
+	// Set if pagetable if invalid.
+	if (!valid) {
+		pgdir[idx] = init_second_level();
+	}
+
+	pgtbl_entry_t *pgtbl = (pgtbl_entry_t *)(pgdir[idx].pde & ~PG_VALID);
+
+	// Use vaddr to get index into 2nd-level page table
+	return &pgtbl[PGTBL_INDEX(vaddr)];
+#endif
+}
+
+/*
+ * Brings the page at vaddr into memory ahead of any reference to it, from
+ * swap or zero-filled, unless it is there already. The page is marked with
+ * flag (PG_PREFETCH or PG_HUGEFILL) but not referenced. The replacement
+ * algorithm is told through its insert_fcn, not ref_fcn, so that the page
+ * comes in cold. Reads from swap are queued on the swap device without
+ * waiting for them.
+ * Return: 1 if the page was brought in.
+ */
+static int bring_in(addr_t vaddr, unsigned flag) {
+	pgtbl_entry_t *p = lookup_pte(vaddr);
+	int frame;
+
+	if (p->frame & PG_VALID)
+		return 0;
+
+	// Flagged already while evict_fcn runs, see incoming_pte.
+	p->frame |= flag;
+	frame = allocate_frame(p, vaddr);
+	p->frame = (p->frame & ~PAGE_MASK) | (frame << PAGE_SHIFT);
+	if (p->frame & PG_ONSWAP) {
+		p->frame &= ~PG_DIRTY;
+		swap_pagein(frame, p->swap_slot);
+		cost_swapin(0);
+	} else {
+		// Will write to swap if evicted, like any new page.
+		p->frame |= PG_DIRTY;
+		init_frame(frame, vaddr);
+	}
+	p->frame &= ~PG_REF;
+	p->frame |= PG_VALID | flag;
+	coremap.last_ref[frame] = ref_count;
+	if (huge_pages > 0)
+		huge_page_in(vaddr);
+	if (insert_fcn != NULL)
+		insert_fcn(p);
+	return 1;
+}
+
+/*
+ * Sequential read-ahead: brings the readahead pages that follow the page of
+ * vaddr into memory, if they are not there yet.
+ */
+static void read_ahead(addr_t vaddr) {
+	addr_t page = vaddr >> PAGE_SHIFT;
+	unsigned i;
+
+	for (i = 1; i <= readahead; i++) {
+		addr_t next = (page + i) << PAGE_SHIFT;
+
+		if (PGDIR_INDEX(next) >= PTRS_PER_PGDIR)
+			break; // End of the address space
+		prefetch_count += bring_in(next, PG_PREFETCH);
+	}
+}
+
+/*
+ * Brings the rest of the huge page region of vaddr into memory, so that it
+ * can be promoted once vaddr's page is in too.
+ */
+static void huge_fill(addr_t vaddr) {
+	addr_t page = vaddr >> PAGE_SHIFT;
+	addr_t first = page - page % huge_pages;
+	addr_t i;
+
+	for (i = first; i < first + huge_pages; i++) {
+		if (i != page)
+			huge_fill_count += bring_in(i << PAGE_SHIFT,
+						    PG_HUGEFILL);
+	}
+}
+
 /*
  * Locate the physical frame number for the given vaddr using the page table.
  *
@@ -160,28 +605,37 @@ void init_frame(int frame, addr_t vaddr) {
  * this function.
  */
 char *find_physpage(addr_t vaddr, char type) {
-	pgtbl_entry_t *p=NULL; // pointer to the full page table entry for vaddr
-	unsigned idx = PGDIR_INDEX(vaddr); // get index into page directory
-
-	// Use top-level page directory to get pointer to 2nd-level page table
-	int valid = pgdir[idx].pde & PG_VALID;
-
-	// Set if pagetable if invalid.
-	if (!valid) {
-		pgdir[idx] = init_second_level();
+	pgtbl_entry_t *p = NULL; // the full page table entry
+	int walked = 1;
+
+	// A TLB hit gives the page table entry without walking the table, and
+	// the page is in memory.
+	if (tlb_entries > 0 && (p = tlb_lookup(vaddr)) != NULL) {
+		assert(p->frame & PG_VALID);
+		walked = 0;
+	} else {
+		p = lookup_pte(vaddr);
+		if (tlb_entries > 0)
+			cost_walk();
 	}
 
-	pgtbl_entry_t *pgtbl = (pgtbl_entry_t *)(pgdir[idx].pde & ~PG_VALID);
+	if (!(p->frame & PG_VALID)) {
+		cost_fault_begin();
 
-	// Use vaddr to get index into 2nd-level page table and initialize 'p'
-	p = &pgtbl[PGTBL_INDEX(vaddr)];
+		// Read ahead first, so that the pages read ahead cannot take the
+		// frame of the page that is needed now. Same for huge pages.
+		if (huge_pages > 0 && huge_should_fill(vaddr))
+			huge_fill(vaddr);
+		if (readahead > 0)
+			read_ahead(vaddr);
+	}
 
 	// Check if p is valid or not, on swap or not, and handle appropriately
 
 	// If page table entry is invalid and not on swap, initialize new frame.
 	if (!(p->frame & PG_VALID) && !(p->frame & PG_ONSWAP)){
 		//Pick a new frame to put in.
-		int frame = allocate_frame(p);
+		int frame = allocate_frame(p, vaddr);
 		p->frame = (p->frame & ~PAGE_MASK) | (frame << PAGE_SHIFT);
 
 		// Will write to swap if evicted, because *p is a new pte.
@@ -189,28 +643,46 @@ char *find_physpage(addr_t vaddr, char type) {
 
 		init_frame(frame, vaddr);
 		miss_count++;
+		cur_proc->miss_count++;
+		cost_fault_end();
+		if (huge_pages > 0)
+			huge_page_in(vaddr);
 
 	} else if (!(p->frame & PG_VALID) && (p->frame & PG_ONSWAP)) {
 		// If page table entry is invalid and on swap, then get from swap.
 
 		// Set frame number of pte to this new frame.
-		int frame = allocate_frame(p);
+		int frame = allocate_frame(p, vaddr);
 		p->frame = (p->frame & ~PAGE_MASK) | (frame << PAGE_SHIFT);
 
 		// Set to not dirty: swap and memory match.
 		p->frame &= ~PG_DIRTY;
 		//Read from swap location.
-		int failed = swap_pagein(frame, p->swap_off);
+		int failed = swap_pagein(frame, p->swap_slot);
 		if (failed){
 /* ANNOTATION 11: (-1) */
 			//p->frame & PG_ONSWAP = 1, so this shouldn't happen.
 /* END ANNOTATION 11 */
 		}
+		cost_swapin(1);
 		miss_count++;
+		cur_proc->miss_count++;
+		cost_fault_end();
+		if (huge_pages > 0)
+			huge_page_in(vaddr);
 	}
 	else{
 		// Otherwise it is valid.
 		hit_count++;
+		cur_proc->hit_count++;
+		if (p->frame & PG_PREFETCH) {
+			p->frame &= ~PG_PREFETCH;
+			prefetch_hit_count++;
+		}
+		if (p->frame & PG_HUGEFILL) {
+			p->frame &= ~PG_HUGEFILL;
+			huge_fill_hit_count++;
+		}
 	}
 
 	// Make sure that p is marked valid and referenced. Also mark it
@@ -222,10 +694,34 @@ char *find_physpage(addr_t vaddr, char type) {
 		p->frame |= PG_DIRTY;
 
 	ref_count++;
+	cost_access();
+	coremap.last_ref[p->frame >> PAGE_SHIFT] = ref_count;
+	if (cleaner_period > 0 && ref_count % cleaner_period == 0)
+		page_cleaner();
+
+	// Working set accounting, for local replacement
+	if (local_window > 0) {
+		int frame = p->frame >> PAGE_SHIFT;
+
+		if (coremap.ws_window[frame] != ws_window) {
+			coremap.ws_window[frame] = ws_window;
+			cur_proc->ws_refs++;
+		}
+		if (ref_count % local_window == 0)
+			ws_end_window();
+	}
+
+	// The aging timer runs on references, with the reference bit of this
+	// one already set.
+	if (tick_fcn != NULL && ref_count % aging_period == 0)
+		tick_fcn();
 
 	// Call replacement algorithm's ref_fcn for this page
 	ref_fcn(p);
 
+	if (tlb_entries > 0 && walked)
+		tlb_fill(vaddr, p);
+
 	// Return pointer into (simulated) physical memory at start of frame
 	return  &physmem[(p->frame >> PAGE_SHIFT)*SIMPAGESIZE];
 }
@@ -257,7 +753,7 @@ void print_pagetbl(pgtbl_entry_t *pgtbl) {
 				printf("in frame %d\n",pgtbl[i].frame >> PAGE_SHIFT);
 			} else {
 				assert(pgtbl[i].frame & PG_ONSWAP);
-				printf("ONSWAP, at offset %lu\n",pgtbl[i].swap_off);
+				printf("ONSWAP, in slot %d\n",pgtbl[i].swap_slot);
 			}
 		}
 	}
@@ -267,7 +763,31 @@ void print_pagetbl(pgtbl_entry_t *pgtbl) {
 	}
 }
 
-void print_pagedirectory() {
+/*
+ * Returns the second-level pagetable for page directory index i, or NULL if
+ * it is invalid. With a flat pagetable, the matching slice of the table is
+ * returned if any page in it has been used.
+ */
+pgtbl_entry_t *pgdir_table(int i) {
+#ifdef FLAT_PAGETABLE
+	pgtbl_entry_t *pgtbl = &flat_pgtbl[i * PTRS_PER_PGTBL];
+	int j;
+
+	for (j=0; j < PTRS_PER_PGTBL; j++) {
+		if (pgtbl[j].frame != 0) {
+			return pgtbl;
+		}
+	}
+	return NULL;
+#else
+	if (!(pgdir[i].pde & PG_VALID)) {
+		return NULL;
+	}
+	return (pgtbl_entry_t *)(pgdir[i].pde & PAGE_MASK);
+#endif
+}
+
+static void print_process_pagedirectory() {
 	int i; // index into pgdir
 	int first_invalid,last_invalid;
 	first_invalid = last_invalid = -1;
@@ -275,7 +795,7 @@ void print_pagedirectory() {
 	pgtbl_entry_t *pgtbl;
 
 	for (i=0; i < PTRS_PER_PGDIR; i++) {
-		if (!(pgdir[i].pde & PG_VALID)) {
+		if ((pgtbl = pgdir_table(i)) == NULL) {
 			if (first_invalid == -1) {
 				first_invalid = i;
 			}
@@ -286,9 +806,27 @@ void print_pagedirectory() {
 				       first_invalid, last_invalid);
 				first_invalid = last_invalid = -1;
 			}
-			pgtbl = (pgtbl_entry_t *)(pgdir[i].pde & PAGE_MASK);
 			printf("[%d]: %p\n",i, pgtbl);
 			print_pagetbl(pgtbl);
 		}
 	}
 }
+
+/*
+ * Prints the page directory of every process that made references, with a
+ * header for each one if there is more than one.
+ */
+void print_pagedirectory() {
+	struct process *cur = cur_proc;
+	int i;
+
+	for (i = 0; i < num_procs; i++) {
+		if (procs[i].hit_count + procs[i].miss_count == 0)
+			continue; // Process 0 when all references have pids
+		if (num_procs > 1)
+			printf("Process %d:\n", procs[i].pid);
+		set_process(procs[i].pid);
+		print_process_pagedirectory();
+	}
+	set_process(cur->pid);
+}
@@ -14,6 +14,10 @@
 #define PG_DIRTY        (0x2) // Dirty bit in pgd or pte, set if modified
 #define PG_REF          (0x4) // Reference bit, set if page has been referenced
 #define PG_ONSWAP       (0x8) // Set if page has been evicted to swap
+#define PG_PREFETCH     (0x10) // Set if page was read ahead and has not
+                               // been referenced yet
+#define PG_HUGEFILL     (0x20) // Set if page was brought in to fill a huge
+                               // page and has not been referenced yet
 #define INVALID_SWAP    -1
 
 #ifdef TRACE_64
@@ -50,41 +54,114 @@ typedef struct {
 	uintptr_t pde;
 } pgdir_entry_t;
 
-// Page table entry (2nd-level).
+// Page table entry (2nd-level). 8 bytes, swap slots are ints everywhere.
 typedef struct {
 	unsigned int frame; // if valid bit == 1, physical frame holding vpage
-	off_t swap_off;       // offset in swap file of vpage, if any
+	int swap_slot;      // slot in swap file of vpage, if any
 } pgtbl_entry_t;
 
+// Building with -DFLAT_PAGETABLE replaces the two-level page table with a
+// single flat array indexed by virtual page number. The array is reserved
+// with mmap and only the parts that are touched get memory, so translating
+// an address is one index with no page directory lookup.
+#define NUM_VPAGES      (PTRS_PER_PGDIR * PTRS_PER_PGTBL)
+
 extern void init_pagetable();
+extern void destroy_pagetable();
 extern char *find_physpage(addr_t vaddr, char type);
+extern void clean_frame(int frame);
 
 extern void print_pagedirectory(void);
 
-struct frame {
-	char in_use;       // True if frame is allocated, False if frame is free
-	pgtbl_entry_t *pte;// Pointer back to pagetable entry (pte) for page
-	                   // stored in this frame
+/* The coremap holds information about physical memory.
+ * The index into each of its arrays is the physical page frame number
+ * stored in the page table entry (pgtbl_entry_t). It is a set of parallel
+ * arrays rather than an array of structs, so that a loop over frames that
+ * only needs one field reads contiguous memory. Replacement algorithms
+ * keep their own per-frame metadata in arrays of their own.
+ */
+struct coremap {
+	uint64_t *in_use;       // Bitmap of allocated frames, 64 to a word
+	pgtbl_entry_t **pte;    // Pointer back to pagetable entry (pte) for
+	                        // the page stored in each frame
+	addr_t *page;           // Virtual page number of that page
+	int *proc;              // Index in procs of the process owning it
+	unsigned *last_ref;     // ref_count at the last reference to it,
+	                        // used by the page cleaner
+	unsigned *ws_window;    // Working set window of that reference, or 0
+	                        // if it was not referenced since it came in
 };
 
-/* The coremap holds information about physical memory.
- * The index into coremap is the physical page frame number stored
- * in the page table entry (pgtbl_entry_t).
+extern __thread struct coremap coremap;
+extern void init_coremap(void);
+extern void destroy_coremap(void);
+
+#define FRAME_IN_USE(frame) \
+	((coremap.in_use[(frame) / 64] >> ((frame) % 64)) & 1)
+
+/* A simulated process, identified by the pid its references are tagged
+ * with in the trace (see trace.h). Each has its own page table.
  */
-extern struct frame *coremap;
+struct process {
+	int pid;
+#ifdef FLAT_PAGETABLE
+	pgtbl_entry_t *pgtbl;
+#else
+	pgdir_entry_t *pgdir;
+#endif
+	unsigned resident;  // Number of frames holding its pages
+	unsigned quota;     // Frames it may hold under local replacement
+	unsigned ws;        // Working set size in the last window
+	unsigned ws_refs;   // Distinct pages referenced in the current window
+	int hit_count;
+	int miss_count;
+};
+
+extern __thread struct process *procs;
+extern __thread int num_procs;
+extern __thread struct process *cur_proc; // Process making the references
+extern void set_process(int pid);
+
+/* With local replacement, allocate_frame restricts which frames the
+ * replacement algorithm may choose: those of the faulting process once it
+ * has all the frames its working set entitles it to, otherwise those of
+ * processes over their quota. Algorithms that support local replacement
+ * only choose frames for which frame_evictable is true.
+ */
+#define EVICT_ANY         -1
+#define EVICT_OVER_QUOTA  -2
+extern __thread int evict_from; // EVICT_ANY, EVICT_OVER_QUOTA or an index
+                                // in procs
+
+static inline int frame_evictable(int frame) {
+	struct process *owner;
+
+	if (evict_from == EVICT_ANY)
+		return 1;
+	if (evict_from != EVICT_OVER_QUOTA)
+		return coremap.proc[frame] == evict_from;
+	owner = &procs[coremap.proc[frame]];
+	return owner->resident > owner->quota;
+}
 
 
 // Swap functions for use in other files
 extern int swap_init(unsigned swapsize);
 extern void swap_destroy(void);
-extern int swap_pagein(unsigned frame, int swap_offset);
-extern int swap_pageout(unsigned frame, int swap_offset);
+extern int swap_pagein(unsigned frame, int swap_slot);
+extern int swap_pageout(unsigned frame, int swap_slot);
 
 extern void rand_init();
 extern void lru_init();
 extern void clock_init();
 extern void fifo_init();
 extern void opt_init();
+extern void arc_init();
+extern void twoq_init();
+extern void lirs_init();
+extern void clockpro_init();
+extern void aging_init();
+extern void wsclock_init();
 
 // These may not need to do anything for some algorithms
 extern void rand_ref(pgtbl_entry_t *);
@@ -92,11 +169,38 @@ extern void lru_ref(pgtbl_entry_t *);
 extern void clock_ref(pgtbl_entry_t *);
 extern void fifo_ref(pgtbl_entry_t *);
 extern void opt_ref(pgtbl_entry_t *);
+extern void arc_ref(pgtbl_entry_t *);
+extern void twoq_ref(pgtbl_entry_t *);
+extern void lirs_ref(pgtbl_entry_t *);
+extern void clockpro_ref(pgtbl_entry_t *);
+extern void aging_ref(pgtbl_entry_t *);
+extern void wsclock_ref(pgtbl_entry_t *);
 
 extern int rand_evict();
 extern int lru_evict();
 extern int clock_evict();
 extern int fifo_evict();
 extern int opt_evict();
+extern int arc_evict();
+extern int twoq_evict();
+extern int lirs_evict();
+extern int clockpro_evict();
+extern int aging_evict();
+extern int wsclock_evict();
+
+// Called from allocate_frame, only needed by some algorithms
+extern void fifo_alloc(int frame);
+extern void aging_alloc(int frame);
+extern void wsclock_alloc(int frame);
+
+// Called for pages brought in without a reference, only needed by
+// algorithms that would otherwise not know about the page
+extern void lru_insert(pgtbl_entry_t *);
+extern void clock_insert(pgtbl_entry_t *);
+extern void arc_insert(pgtbl_entry_t *);
+extern void twoq_insert(pgtbl_entry_t *);
+extern void lirs_insert(pgtbl_entry_t *);
+extern void clockpro_insert(pgtbl_entry_t *);
+extern void wsclock_insert(pgtbl_entry_t *);
 
 #endif /* PAGETABLE_H */
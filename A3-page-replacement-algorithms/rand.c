@@ -6,9 +6,9 @@
 #include "sim.h"
 #include "pagetable.h"
 
-
-
-extern struct frame *coremap;
+// Each simulation has its own random sequence, so results do not depend on
+// what other threads are doing.
+static __thread unsigned int seed;
 
 /* Page to evict is chosen using the rand algorithm.
  * Returns the page frame number (which is also the index in the coremap)
@@ -16,8 +16,11 @@ extern struct frame *coremap;
  */
 int rand_evict() {
 	// choose index in coremap to evict a page from
-	int idx = (int)(random() % memsize);
-	
+	int idx = (int)(rand_r(&seed) % memsize);
+
+	// Under local replacement, the next frame that may be taken.
+	while (!frame_evictable(idx))
+		idx = (idx + 1) % memsize;
 	return idx;
 }
 
@@ -31,4 +34,5 @@ void rand_ref(pgtbl_entry_t *p) {
 }
 
 void rand_init() {
+	seed = 1;
 }
@@ -4,32 +4,54 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "sim.h"
 #include "pagetable.h"
+#include "trace.h"
+#include "stats.h"
 
 // Define global variables declared in sim.h
-unsigned memsize = 0;
+__thread unsigned memsize = 0;
 int debug = 0;
-char *physmem = NULL;
-struct frame *coremap = NULL;
+__thread char *physmem = NULL;
+__thread struct coremap coremap;
 char *tracefile = NULL;
+uint64_t *trace_recs = NULL;
+uint64_t trace_len = 0;
+unsigned aging_period = 100;
+unsigned wsclock_window = 1000;
+unsigned cleaner_period = 0;
+unsigned readahead = 0;
+unsigned local_window = 0;
 
 /* The algs array gives us a mapping between the name of an eviction
  * algorithm as given in a command line argument, and the function to
  * call to select the victim page.
  */
 struct functions algs[] = {
-	{"rand", rand_init, rand_ref, rand_evict},
-	{"lru", lru_init, lru_ref, lru_evict},
-	{"fifo", fifo_init, fifo_ref, fifo_evict},
-	{"clock",clock_init, clock_ref, clock_evict},
-	{"opt", opt_init, opt_ref, opt_evict}
+	{"rand", rand_init, rand_ref, rand_evict, NULL, 1},
+	{"lru", lru_init, lru_ref, lru_evict, NULL, 1, lru_insert},
+	{"fifo", fifo_init, fifo_ref, fifo_evict, fifo_alloc, 1},
+	{"clock",clock_init, clock_ref, clock_evict, NULL, 1, clock_insert},
+	{"opt", opt_init, opt_ref, opt_evict},
+	{"arc", arc_init, arc_ref, arc_evict, NULL, 0, arc_insert},
+	{"2q", twoq_init, twoq_ref, twoq_evict, NULL, 0, twoq_insert},
+	{"lirs", lirs_init, lirs_ref, lirs_evict, NULL, 0, lirs_insert},
+	{"clockpro", clockpro_init, clockpro_ref, clockpro_evict, NULL, 0,
+	 clockpro_insert},
+	{"aging", aging_init, aging_ref, aging_evict, aging_alloc, 1,
+	 NULL, aging_tick},
+	{"wsclock", wsclock_init, wsclock_ref, wsclock_evict, wsclock_alloc, 1,
+	 wsclock_insert}
 };
-int num_algs = 5;
+int num_algs = sizeof(algs) / sizeof(algs[0]);
 
-void (*init_fcn)() = NULL;
-void (*ref_fcn)(pgtbl_entry_t *) = NULL;
-int (*evict_fcn)() = NULL;
+__thread void (*init_fcn)() = NULL;
+__thread void (*ref_fcn)(pgtbl_entry_t *) = NULL;
+__thread int (*evict_fcn)() = NULL;
+__thread void (*alloc_fcn)(int) = NULL;
+__thread void (*insert_fcn)(pgtbl_entry_t *) = NULL;
+__thread void (*tick_fcn)(void) = NULL;
 
 
 /* An actual memory access based on the vaddr from the trace file.
@@ -47,9 +69,15 @@ int (*evict_fcn)() = NULL;
  * counter.
  */
 void access_mem(char type, addr_t vaddr) {
-	char *memptr = find_physpage(vaddr, type);
-	int *versionptr = (int *)memptr;
-	addr_t *checkaddr = (addr_t *)(memptr + sizeof(int));
+	char *memptr;
+	int *versionptr;
+	addr_t *checkaddr;
+	STATS_START(start);
+
+	memptr = find_physpage(vaddr, type);
+	STATS_STOP(PHASE_TRANSLATE, start);
+	versionptr = (int *)memptr;
+	checkaddr = (addr_t *)(memptr + sizeof(int));
 
 	if (*checkaddr != vaddr) {
 		fprintf(stderr,"Error, simulated page returned by pagetable lookup doese not have expected value.\n");
@@ -63,40 +91,434 @@ void access_mem(char type, addr_t vaddr) {
 }
 
 
-void replay_trace(FILE *infp) {
-	char buf[MAXLINE];
+/* Reads the next reference to replay, from the trace or from the window of
+ * streaming OPT, timed as the parse phase.
+ */
+static int next_ref(struct trace *t, char *type, addr_t *vaddr, int stream) {
+	int more;
+	STATS_START(start);
+
+	more = stream ? opt_next(t, type, vaddr) : trace_next(t, type, vaddr);
+	STATS_STOP(PHASE_PARSE, start);
+	return more;
+}
+
+void replay_trace(struct trace *t) {
 	addr_t vaddr = 0;
 	char type;
+	// Streaming OPT reads ahead in the trace and hands the references
+	// over from its window.
+	int stream = opt_window > 0 && init_fcn == opt_init;
+
+	while(next_ref(t, &type, &vaddr, stream)) {
+		if(debug)  {
+			printf("%c %lx %d\n", type, vaddr, t->pid);
+		}
+		if (t->pid != cur_proc->pid)
+			set_process(t->pid);
+		access_mem(type, vaddr);
+	}
+}
+
+
+/* Sharded mode models a set-partitioned physical memory: page p of process
+ * pid can only be held by a frame of set hash(pid, p) % num_shards, and
+ * each set has its own frames and its own instance of the replacement
+ * algorithm. The sets are independent, so each one is replayed on its own
+ * thread, over the references to its own pages. The trace is split into
+ * the references of each set once, before the threads start.
+ */
+static int num_shards = 0;
+static uint64_t **shard_recs;  // Records of each shard, in trace order
+static uint64_t *shard_len;
+
+static int shard_of(int pid, addr_t vaddr) {
+	uint64_t key = ((uint64_t)pid << TRACE_PID_SHIFT) | (vaddr >> PAGE_SHIFT);
+
+	return (int)(((key * 0x9e3779b97f4a7c15ULL) >> 32) % num_shards);
+}
+
+/* Splits the loaded trace into the records of each shard, in one pass.
+ */
+static void split_trace() {
+	struct trace t;
+	addr_t vaddr = 0;
+	char type;
+	uint64_t *cap;
+	int i;
+
+	shard_recs = calloc(num_shards, sizeof(uint64_t *));
+	shard_len = calloc(num_shards, sizeof(uint64_t));
+	cap = malloc(num_shards * sizeof(uint64_t));
+	if (shard_recs == NULL || shard_len == NULL || cap == NULL) {
+		perror("Failed to allocate shard traces");
+		exit(1);
+	}
+	for (i = 0; i < num_shards; i++) {
+		cap[i] = trace_len / num_shards + 1024;
+		if ((shard_recs[i] = malloc(cap[i] * sizeof(uint64_t))) == NULL) {
+			perror("Failed to allocate shard traces");
+			exit(1);
+		}
+	}
 
-	while(fgets(buf, MAXLINE, infp) != NULL) {
-		if(buf[0] != '=') {
-			sscanf(buf, "%c %lx", &type, &vaddr);
-			if(debug)  {
-				printf("%c %lx\n", type, vaddr);
+	trace_from_records(&t, trace_recs, trace_len);
+	while (trace_next(&t, &type, &vaddr)) {
+		i = shard_of(t.pid, vaddr);
+		if (shard_len[i] == cap[i]) {
+			cap[i] *= 2;
+			shard_recs[i] = realloc(shard_recs[i],
+						cap[i] * sizeof(uint64_t));
+			if (shard_recs[i] == NULL) {
+				perror("Failed to grow shard traces");
+				exit(1);
 			}
-			access_mem(type, vaddr);
-		} else {
-			continue;
 		}
+		shard_recs[i][shard_len[i]++] = trace_pack_ref(type, vaddr,
+							       t.pid);
+	}
+	free(cap);
+}
+
 
+/* Returns the eviction algorithm called name, or NULL if there is none.
+ */
+struct functions *find_alg(const char *name) {
+	int i;
+	for (i = 0; i < num_algs; i++) {
+		if(strcmp(algs[i].name, name) == 0) {
+			return &algs[i];
+		}
 	}
+	return NULL;
 }
 
+/* Sets up a simulated machine with msize frames of memory and swapsize
+ * pages of swap, using replacement algorithm alg, on the calling thread.
+ */
+void sim_start(struct functions *alg, unsigned msize, unsigned swapsize) {
+	memsize = msize;
+	STATS_RESET();
+
+	// Initialize main data structures for simulation.
+	// This happens before calling the replacement algorithm init function
+	// so that the init_fcn can refer to the coremap if needed.
+	init_coremap();
+	physmem = malloc(memsize * SIMPAGESIZE);
+	swap_init(swapsize);
+	init_pagetable();
+
+	// Initialize replacement algorithm functions.
+	init_fcn = alg->init;
+	ref_fcn = alg->ref;
+	evict_fcn = alg->evict;
+	alloc_fcn = alg->alloc;
+	insert_fcn = alg->insert;
+	tick_fcn = alg->tick;
+
+	// Call replacement algorithm's init_fcn before replaying trace.
+	init_fcn();
+}
+
+/* Releases everything sim_start set up on the calling thread.
+ */
+void sim_stop() {
+	// Cleanup - removes temporary swapfile.
+	swap_destroy();
+	destroy_pagetable();
+	destroy_coremap();
+	free(physmem);
+	physmem = NULL;
+}
+
+/* Sweep mode runs one simulation for every (algorithm, memory size) pair
+ * over a trace that is loaded only once, spread over worker threads.
+ * Sharded mode uses the same jobs, one per shard.
+ */
+struct sweep_job {
+	struct functions *alg;
+	unsigned memsize;
+	int hit_count;
+	int miss_count;
+	int evict_clean_count;
+	int evict_dirty_count;
+	int writeback_count;
+	int ref_count;
+	unsigned long long sim_time;
+	unsigned long long fault_p99;
+	int opt_ambiguous_count;
+};
+
+static struct sweep_job *jobs;
+static int num_jobs;
+static int next_job;
+static unsigned sweep_swapsize;
+
+void *sweep_worker(void *arg) {
+	int i;
+	struct trace trace;
+
+	while ((i = __sync_fetch_and_add(&next_job, 1)) < num_jobs) {
+		struct sweep_job *job = &jobs[i];
+
+		sim_start(job->alg, job->memsize, sweep_swapsize);
+		if (num_shards > 0)
+			trace_from_records(&trace, shard_recs[i], shard_len[i]);
+		else
+			trace_from_records(&trace, trace_recs, trace_len);
+		replay_trace(&trace);
+
+		job->hit_count = hit_count;
+		job->miss_count = miss_count;
+		job->evict_clean_count = evict_clean_count;
+		job->evict_dirty_count = evict_dirty_count;
+		job->writeback_count = writeback_count;
+		job->ref_count = ref_count;
+		job->sim_time = sim_time;
+		job->fault_p99 = fault_latency(99);
+		job->opt_ambiguous_count = opt_ambiguous_count;
+		sim_stop();
+	}
+	return NULL;
+}
+
+/* Runs all the jobs on nthreads worker threads, over the loaded trace.
+ */
+void run_jobs(int nthreads) {
+	pthread_t *threads;
+	int i;
+
+	if (nthreads > num_jobs)
+		nthreads = num_jobs;
+	if ((threads = malloc(nthreads * sizeof(pthread_t))) == NULL) {
+		perror("Failed to allocate threads");
+		exit(1);
+	}
+	next_job = 0;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, sweep_worker, NULL) != 0) {
+			perror("Failed to create worker thread");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+}
+
+/* Runs the sweep over trace and prints one CSV line per job, in the order
+ * the algorithms and memory sizes were given.
+ */
+void sweep(struct trace *trace, int nthreads) {
+	int i;
+
+	trace_recs = trace_load(trace, &trace_len);
+	run_jobs(nthreads);
+
+	printf("algorithm,memsize,hits,misses,clean_evictions,"
+	       "dirty_evictions,writebacks,references,hit_rate,miss_rate,"
+	       "time_ns,amat_ns,fault_p99_ns\n");
+	for (i = 0; i < num_jobs; i++) {
+		struct sweep_job *job = &jobs[i];
+		printf("%s,%u,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%llu,%.1f,%llu\n",
+		       job->alg->name,
+		       job->memsize, job->hit_count, job->miss_count,
+		       job->evict_clean_count, job->evict_dirty_count,
+		       job->writeback_count, job->ref_count,
+		       (double)job->hit_count/job->ref_count * 100,
+		       (double)job->miss_count/job->ref_count * 100,
+		       job->sim_time, (double)job->sim_time/job->ref_count,
+		       job->fault_p99);
+	}
+
+	// Summary on stderr, so stdout stays plain CSV: the algorithm with the
+	// best hit rate and the one with the lowest simulated time for each
+	// memory size. OPT is the bound to compare against, not a candidate.
+	for (i = 0; i < num_jobs; i++) {
+		struct sweep_job *best = NULL, *fastest = NULL;
+		int j;
+
+		for (j = 0; j < num_jobs; j++) {
+			if (jobs[j].memsize != jobs[i].memsize)
+				continue;
+			if (j < i)
+				break; // Size already reported
+			if (strcmp(jobs[j].alg->name, "opt") != 0 &&
+			    (best == NULL || jobs[j].hit_count > best->hit_count))
+				best = &jobs[j];
+			if (strcmp(jobs[j].alg->name, "opt") != 0 &&
+			    (fastest == NULL ||
+			     jobs[j].sim_time < fastest->sim_time))
+				fastest = &jobs[j];
+		}
+		if (j == num_jobs && best != NULL) {
+			fprintf(stderr, "Best hit rate with %u frames: %s (%.4f)\n",
+				best->memsize, best->alg->name,
+				(double)best->hit_count/best->ref_count * 100);
+			fprintf(stderr, "Lowest simulated time with %u frames: "
+				"%s (%.1f ns per reference)\n",
+				fastest->memsize, fastest->alg->name,
+				(double)fastest->sim_time/fastest->ref_count);
+		}
+		if (opt_window > 0 && strcmp(jobs[i].alg->name, "opt") == 0)
+			fprintf(stderr, "Streaming opt with %u frames: at most "
+				"%d misses more than exact opt\n",
+				jobs[i].memsize, jobs[i].opt_ambiguous_count);
+	}
+}
+
+/* Replays trace on shards threads, one per set of a memory of msize frames,
+ * and prints the summary of all of them together.
+ */
+void shard(struct trace *trace, struct functions *alg, unsigned msize,
+	   int shards) {
+	struct sweep_job total;
+	int i;
+
+	num_shards = num_jobs = shards;
+	if ((jobs = calloc(num_jobs, sizeof(struct sweep_job))) == NULL) {
+		perror("Failed to allocate shards");
+		exit(1);
+	}
+	for (i = 0; i < shards; i++) {
+		jobs[i].alg = alg;
+		jobs[i].memsize = msize / shards + (i < msize % shards);
+	}
+	trace_recs = trace_load(trace, &trace_len);
+	split_trace();
+	run_jobs(shards);
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < shards; i++) {
+		free(shard_recs[i]);
+		total.hit_count += jobs[i].hit_count;
+		total.miss_count += jobs[i].miss_count;
+		total.evict_clean_count += jobs[i].evict_clean_count;
+		total.evict_dirty_count += jobs[i].evict_dirty_count;
+		total.writeback_count += jobs[i].writeback_count;
+		total.ref_count += jobs[i].ref_count;
+		total.sim_time += jobs[i].sim_time;
+	}
+	free(shard_recs);
+	free(shard_len);
+
+	printf("Shards: %d\n", shards);
+	printf("Hit count: %d\n", total.hit_count);
+	printf("Miss count: %d\n", total.miss_count);
+	printf("Clean evictions: %d\n", total.evict_clean_count);
+	printf("Dirty evictions: %d\n", total.evict_dirty_count);
+	if (total.writeback_count > 0)
+		printf("Write-backs off the fault path: %d\n",
+		       total.writeback_count);
+	printf("Total references : %d\n", total.ref_count);
+	printf("Hit rate: %.4f\n",
+	       (double)total.hit_count/total.ref_count * 100);
+	printf("Miss rate: %.4f\n",
+	       (double)total.miss_count/total.ref_count * 100);
+	printf("Simulated time: %.3f ms\n", total.sim_time / 1e6);
+	printf("Average access time: %.1f ns\n",
+	       (double)total.sim_time/total.ref_count);
+}
+
+/* Splits a comma separated list in place. Returns the number of items,
+ * which are stored in items (allocated here).
+ */
+int split_list(char *list, char ***items) {
+	int n = 1;
+	char *c;
+
+	for (c = list; *c != '\0'; c++) {
+		if (*c == ',')
+			n++;
+	}
+	if ((*items = malloc(n * sizeof(char *))) == NULL) {
+		perror("Failed to allocate list");
+		exit(1);
+	}
+	n = 0;
+	for (c = strtok(list, ","); c != NULL; c = strtok(NULL, ",")) {
+		(*items)[n++] = c;
+	}
+	return n;
+}
+
+/* Parses the TLB geometry given with -T. Exits with usage on error.
+ */
+void parse_tlb(char *spec, char *usage) {
+	char **items;
+	int n = split_list(spec, &items);
+
+	if (n > 0 && (strcmp(items[n - 1], "rand") == 0 ||
+		      strcmp(items[n - 1], "lru") == 0)) {
+		tlb_random = strcmp(items[--n], "rand") == 0;
+	}
+	if (n != 2 && n != 4) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+	tlb_entries = (unsigned)strtoul(items[0], NULL, 10);
+	tlb_ways = (unsigned)strtoul(items[1], NULL, 10);
+	if (n == 4) {
+		tlb2_entries = (unsigned)strtoul(items[2], NULL, 10);
+		tlb2_ways = (unsigned)strtoul(items[3], NULL, 10);
+	}
+	if (tlb_ways == 0 || tlb_entries % tlb_ways != 0 ||
+	    (tlb2_entries > 0 &&
+	     (tlb2_ways == 0 || tlb2_entries % tlb2_ways != 0))) {
+		fprintf(stderr, "Error: TLB entries must be a multiple of "
+			"its ways\n");
+		exit(1);
+	}
+	free(items);
+}
 
 int main(int argc, char *argv[]) {
 	int opt;
 	unsigned swapsize = 4096;
-	FILE *tfp = stdin;
+	struct trace trace;
 	char *replacement_alg = NULL;
-	char *usage = "USAGE: sim -f tracefile -m memorysize -s swapsize -a algorithm\n";
+	char *memsizes = "0";
+	char **alg_names, **sizes, **costs, **hugeopts;
+	int num_alg_names, num_sizes;
+	int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int curve = 0;
+	struct functions *alg;
+	int i, j, n;
+	int shards = 0;
+	unsigned long bench_refs = 0, bench_pages = 0;
+	char *end;
+	char *usage = "USAGE: sim -f tracefile -m memorysize -s swapsize -a algorithm\n"
+		"       sim -f tracefile -m size,... -s swapsize -a algorithm,... [-t threads]\n"
+		"       sim -f tracefile -c [-m size,...]\n"
+		"       sim -B references[,pages] -m memorysize [-a algorithm,...]\n"
+		"  -S  swap to a temporary file instead of memory\n"
+		"  -C  costs in ns of a hit, minor fault, swap-in and swap-out,\n"
+		"      and optionally of a TLB miss (default\n"
+		"      100,1000,100000,100000,20)\n"
+		"  -T  TLB with entries and ways, and optionally a second level,\n"
+		"      LRU or rand within a set: -T entries,ways[,entries,ways][,rand]\n"
+		"  -P  run the page cleaner every given number of references\n"
+		"  -R  pages to read ahead on a miss (not with opt)\n"
+		"  -H  huge pages of the given number of base pages, filled in\n"
+		"      when a fault finds them percent full (default 50)\n"
+		"      -H pages[,percent]; not with opt\n"
+		"  -N  split memory into the given number of independent sets,\n"
+		"      replayed in parallel (one algorithm and size, not opt)\n"
+		"  -L  local replacement between processes, with frames shared\n"
+		"      by working set size over the given number of references\n"
+		"  -K  references per aging timer tick (default 100)\n"
+		"  -W  WSClock working set window in references (default 1000)\n"
+		"  -O  opt reads the trace as a stream, looking ahead the given\n"
+		"      number of references (default: the whole trace)\n";
 
-	while ((opt = getopt(argc, argv, "f:m:a:s:")) != -1) {
+	while ((opt = getopt(argc, argv, "f:m:a:s:t:cSK:W:C:P:R:L:H:T:N:O:B:")) != -1) {
 		switch (opt) {
 		case 'f':
 			tracefile = optarg;
 			break;
 		case 'm':
-			memsize = (unsigned)strtoul(optarg, NULL, 10);
+			memsizes = optarg;
 			break;
 		case 'a':
 			replacement_alg = optarg;
@@ -104,63 +526,281 @@ int main(int argc, char *argv[]) {
 		case 's':
 			swapsize = (unsigned)strtoul(optarg, NULL, 10);
 			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'c':
+			curve = 1;
+			break;
+		case 'S':
+			swap_use_file = 1;
+			break;
+		case 'K':
+			aging_period = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'C':
+			n = split_list(optarg, &costs);
+			if (n != 4 && n != 5) {
+				fprintf(stderr, "%s", usage);
+				exit(1);
+			}
+			cost_hit_ns = strtoul(costs[0], NULL, 10);
+			cost_minor_ns = strtoul(costs[1], NULL, 10);
+			cost_swapin_ns = strtoul(costs[2], NULL, 10);
+			cost_swapout_ns = strtoul(costs[3], NULL, 10);
+			if (n == 5)
+				cost_walk_ns = strtoul(costs[4], NULL, 10);
+			free(costs);
+			break;
+		case 'P':
+			cleaner_period = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'R':
+			readahead = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			if (split_list(optarg, &hugeopts) > 1)
+				huge_promote_pct = (unsigned)strtoul(hugeopts[1],
+								     NULL, 10);
+			huge_pages = (unsigned)strtoul(hugeopts[0], NULL, 10);
+			free(hugeopts);
+			if (huge_pages & (huge_pages - 1) ||
+			    huge_pages > PTRS_PER_PGTBL) {
+				fprintf(stderr, "Error: huge pages must be a power "
+					"of 2 of at most %d pages\n",
+					PTRS_PER_PGTBL);
+				exit(1);
+			}
+			break;
+		case 'T':
+			parse_tlb(optarg, usage);
+			break;
+		case 'N':
+			shards = atoi(optarg);
+			break;
+		case 'L':
+			local_window = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'W':
+			wsclock_window = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'O':
+			opt_window = strtoul(optarg, NULL, 10);
+			break;
+		case 'B':
+			bench_refs = strtoul(optarg, &end, 10);
+			bench_pages = *end == ',' ? strtoul(end + 1, NULL, 10) : 0;
+			break;
 		default:
 			fprintf(stderr, "%s", usage);
 			exit(1);
 		}
 	}
-	if(tracefile != NULL) {
-		if((tfp = fopen(tracefile, "r")) == NULL) {
-			perror("Error opening tracefile:");
-			exit(1);
+	num_sizes = split_list(memsizes, &sizes);
+
+	// LRU miss ratio curve for every memory size in one pass.
+	if (curve) {
+		unsigned *sizevals = malloc(num_sizes * sizeof(unsigned));
+		for (i = 0; i < num_sizes; i++) {
+			sizevals[i] = (unsigned)strtoul(sizes[i], NULL, 10);
 		}
+		trace_open(&trace, tracefile);
+		lru_curve(&trace, sizevals, num_sizes);
+		trace_close(&trace);
+		return(0);
 	}
 
-	// Initialize main data structures for simulation.
-	// This happens before calling the replacement algorithm init function
-	// so that the init_fcn can refer to the coremap if needed.
-	coremap = calloc(memsize, sizeof(struct frame));
-	physmem = malloc(memsize * SIMPAGESIZE);
-	swap_init(swapsize);
-	init_pagetable();
+	// Benchmark of the given algorithms, or all of them, on synthetic
+	// traces over 4 pages per frame unless told otherwise.
+	if (bench_refs > 0) {
+		struct functions **bench_algs;
+		unsigned msize = (unsigned)strtoul(sizes[0], NULL, 10);
 
-	// Initialize replacement algorithm functions.
-	if(replacement_alg == NULL) {
+		if (msize == 0 || num_sizes > 1) {
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+		num_alg_names = num_algs;
+		if (replacement_alg != NULL)
+			num_alg_names = split_list(replacement_alg, &alg_names);
+		bench_algs = malloc(num_alg_names * sizeof(*bench_algs));
+		if (bench_algs == NULL) {
+			perror("Failed to allocate benchmark");
+			exit(1);
+		}
+		for (i = 0; i < num_alg_names; i++) {
+			bench_algs[i] = replacement_alg != NULL ?
+				find_alg(alg_names[i]) : &algs[i];
+			if (bench_algs[i] == NULL) {
+				fprintf(stderr, "Error: invalid replacement "
+					"algorithm - %s\n", alg_names[i]);
+				exit(1);
+			}
+		}
+		bench(bench_algs, num_alg_names, bench_refs,
+		      bench_pages > 0 ? bench_pages : 4UL * msize, msize);
+		return(0);
+	}
+
+	if(replacement_alg == NULL || nthreads < 1 || aging_period < 1) {
 		fprintf(stderr, "%s", usage);
 		exit(1);
-	} else {
-		int i;
-		for (i = 0; i < num_algs; i++) {
-			if(strcmp(algs[i].name, replacement_alg) == 0) {
-				init_fcn = algs[i].init;
-				ref_fcn = algs[i].ref;
-				evict_fcn = algs[i].evict;
-				break;
+	}
+	num_alg_names = split_list(replacement_alg, &alg_names);
+	for (i = 0; i < num_alg_names; i++) {
+		if(find_alg(alg_names[i]) == NULL) {
+			fprintf(stderr, "Error: invalid replacement algorithm - %s\n",
+					alg_names[i]);
+			exit(1);
+		}
+		// OPT knows the future of the trace's references only.
+		if ((readahead > 0 || huge_pages > 0) &&
+		    strcmp(alg_names[i], "opt") == 0) {
+			fprintf(stderr, "Error: opt cannot be used with read-ahead "
+				"or huge pages\n");
+			exit(1);
+		}
+		if (local_window > 0 && !find_alg(alg_names[i])->local) {
+			fprintf(stderr, "Error: %s does not support local "
+				"replacement\n", alg_names[i]);
+			exit(1);
+		}
+	}
+
+	// Text or binary trace, from tracefile or stdin.
+	trace_open(&trace, tracefile);
+
+	// More than one algorithm or memory size: sweep over all of them.
+	if (num_alg_names * num_sizes > 1) {
+		if (shards > 0) {
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+		num_jobs = num_alg_names * num_sizes;
+		if ((jobs = calloc(num_jobs, sizeof(struct sweep_job))) == NULL) {
+			perror("Failed to allocate sweep");
+			exit(1);
+		}
+		for (i = 0; i < num_alg_names; i++) {
+			for (j = 0; j < num_sizes; j++) {
+				jobs[i*num_sizes + j].alg = find_alg(alg_names[i]);
+				jobs[i*num_sizes + j].memsize =
+					(unsigned)strtoul(sizes[j], NULL, 10);
 			}
 		}
-		if(evict_fcn == NULL) {
-			fprintf(stderr, "Error: invalid replacement algorithm - %s\n",
-					replacement_alg);
+		sweep_swapsize = swapsize;
+		sweep(&trace, nthreads);
+		trace_close(&trace);
+		return(0);
+	}
+
+	alg = find_alg(alg_names[0]);
+	if (shards > 0) {
+		// OPT's next use table is positional over the whole trace.
+		if (strcmp(alg->name, "opt") == 0) {
+			fprintf(stderr, "Error: opt cannot be sharded\n");
+			exit(1);
+		}
+		if ((unsigned)shards > (unsigned)strtoul(sizes[0], NULL, 10)) {
+			fprintf(stderr, "Error: more shards than frames\n");
 			exit(1);
 		}
+		sweep_swapsize = swapsize;
+		shard(&trace, alg, (unsigned)strtoul(sizes[0], NULL, 10),
+		      shards);
+		trace_close(&trace);
+		return(0);
 	}
-	// Call replacement algorithm's init_fcn before replaying trace.
-	init_fcn();
+	// Exact OPT needs the whole trace before the replay. opt_init reads a
+	// file again, but a pipe can only be read once, so it is loaded here.
+	if (strcmp(alg->name, "opt") == 0 && opt_window == 0 &&
+	    tracefile == NULL)
+		trace_recs = trace_load(&trace, &trace_len);
+	sim_start(alg, (unsigned)strtoul(sizes[0], NULL, 10), swapsize);
 
-	replay_trace(tfp);
-	print_pagedirectory();
+	if (trace_recs != NULL) {
+		struct trace loaded;
 
-	// Cleanup - removes temporary swapfile.
-	swap_destroy();
+		trace_from_records(&loaded, trace_recs, trace_len);
+		replay_trace(&loaded);
+	} else {
+		replay_trace(&trace);
+	}
+	trace_close(&trace);
+	print_pagedirectory();
 
 	printf("\n");
+#ifdef SIM_STATS
+	stats_print();
+#endif
 	printf("Hit count: %d\n", hit_count);
 	printf("Miss count: %d\n", miss_count);
 	printf("Clean evictions: %d\n",evict_clean_count);
 	printf("Dirty evictions: %d\n",evict_dirty_count);
+	if (writeback_count > 0)
+		printf("Write-backs off the fault path: %d\n", writeback_count);
+	if (readahead > 0) {
+		printf("Pages read ahead: %d\n", prefetch_count);
+		printf("Read-ahead hits: %d\n", prefetch_hit_count);
+		printf("Read-ahead wasted: %d\n", prefetch_wasted_count);
+	}
+	if (tlb_entries > 0) {
+		printf("TLB hits: %d\n", tlb_hit_count);
+		if (tlb2_entries > 0)
+			printf("Second level TLB hits: %d\n", tlb2_hit_count);
+		printf("Page walks: %d\n", walk_count);
+		printf("TLB hit rate: %.4f\n",
+		       (double)(tlb_hit_count + tlb2_hit_count)/ref_count * 100);
+	}
+	if (huge_pages > 0) {
+		unsigned resident = 0;
+
+		for (i = 0; i < num_procs; i++)
+			resident += procs[i].resident;
+		printf("Huge page promotions: %d\n", huge_promote_count);
+		printf("Huge page splits: %d\n", huge_split_count);
+		printf("Pages filled in: %d\n", huge_fill_count);
+		printf("Faults saved by filling: %d\n", huge_fill_hit_count);
+		printf("Pages filled in and never used: %d\n",
+		       huge_fill_wasted_count);
+		printf("Huge pages mapped at the end: %u (%.2f%% of memory)\n",
+		       huge_mapped, resident > 0 ?
+		       (double)huge_mapped * huge_pages / resident * 100 : 0);
+		printf("TLB entries to map memory: %u (%u with base pages only)\n",
+		       resident - huge_mapped * (huge_pages - 1), resident);
+	}
+	if (opt_window > 0 && alg == find_alg("opt")) {
+		printf("OPT lookahead window: %lu references\n", opt_window);
+		printf("Ambiguous evictions: %d (at most as many misses more "
+		       "than exact OPT)\n", opt_ambiguous_count);
+	}
 	printf("Total references : %d\n", ref_count);
 	printf("Hit rate: %.4f\n", (double)hit_count/ref_count * 100);
 	printf("Miss rate: %.4f\n", (double)miss_count/ref_count *100);
+	printf("Simulated time: %.3f ms\n", sim_time / 1e6);
+	printf("Average access time: %.1f ns\n", (double)sim_time/ref_count);
+	printf("Fault latency p50/p90/p99/max: %llu/%llu/%llu/%llu ns\n",
+	       fault_latency(50), fault_latency(90), fault_latency(99),
+	       fault_latency(100));
+	if (num_procs > 1) {
+		for (i = 0; i < num_procs; i++) {
+			struct process *proc = &procs[i];
+			int refs = proc->hit_count + proc->miss_count;
+
+			if (refs == 0)
+				continue; // Process 0 when all references have pids
+			printf("Process %d: %d hits, %d misses, miss rate %.4f, "
+			       "%u frames", proc->pid, proc->hit_count,
+			       proc->miss_count,
+			       (double)proc->miss_count/refs * 100,
+			       proc->resident);
+			if (local_window > 0)
+				printf(", working set %u, quota %u",
+				       proc->ws, proc->quota);
+			printf("\n");
+		}
+	}
 
+	sim_stop();
 	return(0);
 }
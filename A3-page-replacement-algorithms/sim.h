@@ -1,21 +1,91 @@
 #ifndef __SIM_H__
 #define __SIM_H__
 
+#include <stdint.h>
 #include "pagetable.h"
 #define MAXLINE 256
 #define SIMPAGESIZE 16  /* Simulated physical memory page frame size */
 
-extern unsigned memsize;
+/* Everything that belongs to one simulated machine (memory size, physical
+ * memory, page table, swap, counters and replacement algorithm state) is
+ * thread-local, so that sweep mode can run one simulation per thread.
+ * A single simulation just runs on the main thread.
+ */
+extern __thread unsigned memsize;
 extern int debug;
+extern int swap_use_file;   // Swap to a temporary file instead of memory
+
+extern __thread int hit_count;
+extern __thread int miss_count;
+extern __thread int ref_count;
+extern __thread int evict_clean_count;
+extern __thread int evict_dirty_count;
+extern __thread int writeback_count;
+extern __thread int prefetch_count;        // Pages read ahead
+extern __thread int prefetch_hit_count;    // ... that were then referenced
+extern __thread int prefetch_wasted_count; // ... evicted without a reference
+
+// Timer tick period of aging and working set window of WSClock, in
+// references (sim -K and -W)
+extern unsigned aging_period;
+extern unsigned wsclock_window;
+
+// Timer tick of aging (aging.c)
+extern void aging_tick(void);
+
+// The page cleaner runs every cleaner_period references, 0 to disable (sim -P)
+extern unsigned cleaner_period;
+
+// Pages read ahead after the one that missed, 0 to disable (sim -R)
+extern unsigned readahead;
+
+// Huge pages (hugepage.c, sim -H): base pages per huge page, 0 to disable,
+// and how full a region must be for a fault in it to fill it in
+extern unsigned huge_pages;
+extern unsigned huge_promote_pct;
+extern __thread int huge_promote_count;
+extern __thread int huge_split_count;
+extern __thread int huge_fill_count;        // Pages brought in by filling
+extern __thread int huge_fill_hit_count;    // ... that were then referenced
+extern __thread int huge_fill_wasted_count; // ... evicted without a reference
+extern __thread unsigned huge_mapped;
+extern void huge_init(void);
+extern void huge_destroy(void);
+extern int huge_should_fill(addr_t vaddr);
+extern void huge_page_in(addr_t vaddr);
+extern void huge_page_out(int pid, addr_t vaddr);
+extern int huge_is_mapped(int pid, addr_t vaddr);
+
+// TLB (tlb.c, sim -T): geometry of each level, no TLB if tlb_entries is 0
+// and no second level if tlb2_entries is 0
+extern unsigned tlb_entries;
+extern unsigned tlb_ways;
+extern unsigned tlb2_entries;
+extern unsigned tlb2_ways;
+extern int tlb_random;
+extern __thread int tlb_hit_count;
+extern __thread int tlb2_hit_count;
+extern __thread int walk_count;
+extern void tlb_init(void);
+extern void tlb_destroy(void);
+extern pgtbl_entry_t *tlb_lookup(addr_t vaddr);
+extern void tlb_fill(addr_t vaddr, pgtbl_entry_t *p);
+extern void tlb_invalidate(int pid, addr_t vaddr);
+
+// OPT lookahead window in references when it reads the trace as a stream,
+// 0 to know the whole trace in advance (sim -O). Evictions between pages
+// that are not in the window are guesses, and counted.
+struct trace;
+extern unsigned long opt_window;
+extern __thread int opt_ambiguous_count;
+extern int opt_next(struct trace *t, char *type, addr_t *vaddr);
 
-extern int hit_count;
-extern int miss_count;
-extern int ref_count;
-extern int evict_clean_count;
-extern int evict_dirty_count;
+// Working set window in references for local replacement between
+// processes, 0 for global replacement (sim -L)
+extern unsigned local_window;
 
 /* We simulate physical memory with a large array of bytes */
-extern char *physmem;
+extern __thread char *physmem;
 
 /* The tracefile name is a global variable because the OPT
  * algorithm will need to read the file before you start
@@ -23,17 +93,73 @@ extern char *physmem;
  */
 extern char *tracefile;
 
+/* In sweep mode the whole trace is loaded once and shared by all the
+ * simulations, as binary records (see trace.h). NULL otherwise.
+ */
+extern uint64_t *trace_recs;
+extern uint64_t trace_len;
+
 // Each eviction algorithm is represented by a structure with its name
-// and three functions.
+// and three functions, plus two optional ones, and whether it supports
+// local replacement.
 struct functions {
 	char *name;                  // String name of eviction algorithm
 	void (*init)(void);          // Initialize any data needed by alg
 	void (*ref)(pgtbl_entry_t *);    // Called on each reference
 	int (*evict)();              // Called to choose victim for eviction
+	void (*alloc)(int);          // Called when a frame gets a new page,
+	                             // may be NULL
+	int local;                   // True if evict only chooses frames
+	                             // for which frame_evictable is true
+	void (*insert)(pgtbl_entry_t *); // Called when a page is brought in
+	                             // without a reference (read-ahead, huge
+	                             // page fill), may be NULL
+	void (*tick)(void);          // Called every aging_period references,
+	                             // may be NULL
 };
 
-extern void (*init_fcn)();
-extern void (*ref_fcn)(pgtbl_entry_t *);
-extern int (*evict_fcn)();
+// Simulated time (cost.c). Costs are in nanoseconds.
+extern unsigned long cost_hit_ns;
+extern unsigned long cost_minor_ns;
+extern unsigned long cost_swapin_ns;
+extern unsigned long cost_swapout_ns;
+extern unsigned long cost_walk_ns;
+extern __thread unsigned long long sim_time;
+extern void cost_init(void);
+extern void cost_access(void);
+extern void cost_walk(void);
+extern void cost_fault_begin(void);
+extern void cost_fault_end(void);
+extern void cost_swapin(int wait);
+extern void cost_swapout(int wait);
+extern unsigned long long fault_latency(double pct);
+
+// Running one simulation on the calling thread (sim.c)
+struct trace;
+extern void sim_start(struct functions *alg, unsigned msize,
+		      unsigned swapsize);
+extern void replay_trace(struct trace *t);
+extern void sim_stop(void);
+
+// Benchmark of the replacement algorithms on synthetic traces (bench.c)
+extern void bench(struct functions **alg_list, int num_alg_list,
+		  unsigned long len, unsigned long pages, unsigned msize);
+
+// One-pass LRU miss ratio curve (mrc.c)
+extern void lru_curve(struct trace *t, unsigned *sizes, int num_sizes);
+
+/* The page table entry of the page that is being brought in while evict_fcn
+ * runs. Algorithms that keep history about evicted pages (like ARC) use it
+ * to adapt before choosing a victim. Pages brought in without a reference
+ * are already flagged PG_PREFETCH or PG_HUGEFILL.
+ */
+extern __thread pgtbl_entry_t *incoming_pte;
+
+extern __thread void (*init_fcn)();
+extern __thread void (*ref_fcn)(pgtbl_entry_t *);
+extern __thread int (*evict_fcn)();
+extern __thread void (*alloc_fcn)(int);
+extern __thread void (*insert_fcn)(pgtbl_entry_t *);
+extern __thread void (*tick_fcn)(void);
 
 #endif // __SIM_H 
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <time.h>
+#include "sim.h"
+#include "stats.h"
+
+#ifdef SIM_STATS
+
+// Counters and histograms of the simulation on this thread, see stats.h.
+__thread struct sim_stats sim_stats;
+
+static const char *phase_names[NUM_PHASES] = {
+	"parse", "translate", "evict", "swap I/O"
+};
+
+unsigned long long stats_clock() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Histogram bucket of val: floor(log2(val)), with 0 in bucket 0 and
+// everything past the last bucket in it.
+static int bucket(unsigned long long val) {
+	int i = val > 0 ? 63 - __builtin_clzll(val) : 0;
+
+	return i < STATS_BUCKETS ? i : STATS_BUCKETS - 1;
+}
+
+void stats_phase(enum stats_phase phase, unsigned long long ns) {
+	sim_stats.phase_calls[phase]++;
+	sim_stats.phase_ns[phase] += ns;
+	sim_stats.phase_hist[phase][bucket(ns)]++;
+}
+
+void stats_scan(unsigned long frames) {
+	sim_stats.scans++;
+	sim_stats.scanned += frames;
+	if (frames > sim_stats.scan_max)
+		sim_stats.scan_max = frames;
+	sim_stats.scan_hist[bucket(frames)]++;
+}
+
+/* Prints the non-empty buckets of hist, as "lower bound: count".
+ */
+static void print_hist(const unsigned long *hist) {
+	int i;
+
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		if (hist[i] > 0)
+			printf(" %lu:%lu", i > 0 ? 1UL << i : 0, hist[i]);
+	}
+	printf("\n");
+}
+
+void stats_print() {
+	int i;
+
+	printf("Page tables allocated: %lu\n", sim_stats.pgtbl_allocs);
+	printf("Swap slots allocated: %lu\n", sim_stats.swap_allocs);
+	if (sim_stats.scans > 0) {
+		printf("Frames scanned per eviction: %.1f average, %lu max\n",
+		       (double)sim_stats.scanned / sim_stats.scans,
+		       sim_stats.scan_max);
+		printf("Scan length histogram:");
+		print_hist(sim_stats.scan_hist);
+	}
+	for (i = 0; i < NUM_PHASES; i++) {
+		if (sim_stats.phase_calls[i] == 0)
+			continue;
+		printf("Phase %s: %lu calls, %.3f ms, %.1f ns per call\n",
+		       phase_names[i], sim_stats.phase_calls[i],
+		       sim_stats.phase_ns[i] / 1e6,
+		       (double)sim_stats.phase_ns[i] / sim_stats.phase_calls[i]);
+		printf("Phase %s ns histogram:", phase_names[i]);
+		print_hist(sim_stats.phase_hist[i]);
+	}
+}
+
+#endif /* SIM_STATS */
@@ -0,0 +1,67 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+/* Instrumentation of the simulator's own work (stats.c), compiled in only
+ * with -DSIM_STATS (make sim-stats). Otherwise every macro is empty, so the
+ * hot path pays nothing for it.
+ *
+ * Counters say how much work is done: page tables and swap slots allocated,
+ * and how many frames the evictors of the clock family look at. Phases say
+ * where the replay time goes, as a log2 histogram of the nanoseconds taken
+ * by each call:
+ *
+ *   - parse:     reading the next reference from the trace
+ *   - translate: find_physpage, including evict and swap I/O
+ *   - evict:     the replacement algorithm's evict_fcn
+ *   - swap I/O:  swap_pagein and swap_pageout
+ */
+
+enum stats_phase {
+	PHASE_PARSE,
+	PHASE_TRANSLATE,
+	PHASE_EVICT,
+	PHASE_SWAP,
+	NUM_PHASES
+};
+
+#define STATS_BUCKETS 32   // Bucket i counts times in [2^i, 2^(i+1)) ns
+
+struct sim_stats {
+	unsigned long pgtbl_allocs;   // Second-level (or flat) page tables
+	unsigned long swap_allocs;    // Swap slots
+	unsigned long scans;          // Evictions that scanned frames
+	unsigned long scanned;        // Frames looked at by those evictions
+	unsigned long scan_max;       // Most frames looked at by one eviction
+	unsigned long scan_hist[STATS_BUCKETS];
+	unsigned long phase_calls[NUM_PHASES];
+	unsigned long long phase_ns[NUM_PHASES];
+	unsigned long phase_hist[NUM_PHASES][STATS_BUCKETS];
+};
+
+#ifdef SIM_STATS
+
+#include <string.h>
+
+extern __thread struct sim_stats sim_stats;
+extern unsigned long long stats_clock(void);
+extern void stats_phase(enum stats_phase phase, unsigned long long ns);
+extern void stats_scan(unsigned long frames);
+extern void stats_print(void);
+
+#define STATS_RESET()           memset(&sim_stats, 0, sizeof(sim_stats))
+#define STATS_INC(field)        (sim_stats.field++)
+#define STATS_SCAN(frames)      stats_scan(frames)
+#define STATS_START(var)        unsigned long long var = stats_clock()
+#define STATS_STOP(phase, var)  stats_phase(phase, stats_clock() - (var))
+
+#else
+
+#define STATS_RESET()           do { } while (0)
+#define STATS_INC(field)        do { } while (0)
+#define STATS_SCAN(frames)      ((void)(frames))
+#define STATS_START(var)        do { } while (0)
+#define STATS_STOP(phase, var)  do { } while (0)
+
+#endif /* SIM_STATS */
+
+#endif /* __STATS_H__ */
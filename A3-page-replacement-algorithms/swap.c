@@ -5,8 +5,11 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
 #include "pagetable.h"
 #include "sim.h"
+#include "stats.h"
 
 //---------------------------------------------------------------------
 // Bitmap definitions and functions to manage space in swapfile.
@@ -23,6 +26,7 @@
 struct bitmap {
         unsigned nbits;
         unsigned *v;
+        unsigned hint;  /* Word where the last allocation was made */
 };
 
 struct bitmap *
@@ -44,6 +48,7 @@ bitmap_create(unsigned nbits)
 
         memset(b->v, 0, words*sizeof(unsigned));
         b->nbits = nbits;
+        b->hint = 0;
 
         /* Mark any leftover bits at the end in use */
         if (words > nbits / BITS_PER_WORD) {
@@ -61,26 +66,31 @@ bitmap_create(unsigned nbits)
         return b;
 }
 
+/*
+ * Next fit: the search starts at the word of the last allocation and
+ * wraps around, and the free bit in a word is found with one count
+ * trailing zeros. Swap slots are never freed during a simulation, so
+ * the words before the hint are all full and allocation is O(1).
+ */
 int
 bitmap_alloc(struct bitmap *b, unsigned *index)
 {
-        unsigned ix;
+        unsigned ix, n;
         unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
         unsigned offset;
 
-        for (ix=0; ix<maxix; ix++) {
+        ix = b->hint;
+        for (n=0; n<maxix; n++) {
                 if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                unsigned mask = ((unsigned)1) << offset;
-
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        assert(*index < b->nbits);
-                                        return 0;
-                                }
-                        }
-                        assert(0);
+                        offset = __builtin_ctz(~b->v[ix]);
+                        b->v[ix] |= ((unsigned)1) << offset;
+                        *index = (ix*BITS_PER_WORD)+offset;
+                        assert(*index < b->nbits);
+                        b->hint = ix;
+                        return 0;
+                }
+                if (++ix == maxix) {
+                        ix = 0;
                 }
         }
         return 1;
@@ -143,21 +153,48 @@ bitmap_destroy(struct bitmap *b)
 
 //---------------------------------------------------------------------
 // Swap definitions and functions.
+//
+// By default swap space is kept in memory, so paging in and out is a
+// memcpy. With swap_use_file set (sim -S), it is a temporary file
+// accessed with pread and pwrite, one system call per page.
 
-static int swapfd;
-static struct bitmap *swapmap;
-static char *fname;
+int swap_use_file = 0;
+
+static __thread int swapfd;
+static __thread struct bitmap *swapmap;
+static __thread char *fname;
+static __thread char *swapmem;      // In-memory swap space
+static __thread size_t swapmem_len;
 
 int swap_init(unsigned swapsize) {
 
-	// Initialize the swap file
-	fname = malloc(20);
-	strncpy(fname, "swapfile.XXXXXX",20);
-	if ((swapfd = mkstemp(fname)) == -1) {
-		perror("Failed to create temporary file for swap");
+	// Page table entries hold slots as ints.
+	if (swapsize > INT_MAX) {
+		fprintf(stderr, "Swap size is limited to %d pages\n", INT_MAX);
 		exit(1);
 	}
 
+	if (swap_use_file) {
+		// Initialize the swap file
+		fname = malloc(20);
+		strncpy(fname, "swapfile.XXXXXX",20);
+		if ((swapfd = mkstemp(fname)) == -1) {
+			perror("Failed to create temporary file for swap");
+			exit(1);
+		}
+	} else {
+		// Reserve swap space. Only the slots that are used get memory.
+		swapmem_len = (size_t)swapsize * SIMPAGESIZE;
+		swapmem = mmap(NULL, swapmem_len > 0 ? swapmem_len : 1,
+			       PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+			       -1, 0);
+		if (swapmem == MAP_FAILED) {
+			perror("Failed to allocate memory for swap");
+			exit(1);
+		}
+	}
+
 	// Initialize the bitmap
 	if ((swapmap = bitmap_create(swapsize)) == NULL) {
 		fprintf(stderr,"Failed to create bitmap for swap\n");
@@ -169,42 +206,50 @@ int swap_init(unsigned swapsize) {
 
 void swap_destroy() {
 
-	// Close and remove swapfile
-	close(swapfd);
-	unlink(fname);
+	if (swap_use_file) {
+		// Close and remove swapfile
+		close(swapfd);
+		unlink(fname);
+		free(fname);
+	} else {
+		munmap(swapmem, swapmem_len > 0 ? swapmem_len : 1);
+		swapmem = NULL;
+	}
 
 	// Destroy bitmap
 	bitmap_destroy(swapmap);
 	return;
 }
 
-// Read data into (simulated) physical memory 'frame' from 'swap_offset'
+// Read data into (simulated) physical memory 'frame' from 'swap_slot'
 // in swap file.
 // Input:  frame - the physical frame number (not byte offset) in physmem
-//         swap_offset - the byte position in the swap file.
+//         swap_slot - the slot (not byte offset) in the swap file.
 // Return: 0 on success,
 //	   -errno on error or number of bytes read on partial read
 //
-int swap_pagein(unsigned frame, int swap_offset) {
+static int pagein(unsigned frame, int swap_slot) {
 	char *frame_ptr;
-	off_t pos;
 	ssize_t bytes_read;
+	off_t swap_offset;
 
-	assert(swap_offset != INVALID_SWAP);
+	assert(swap_slot != INVALID_SWAP);
+	swap_offset = (off_t)swap_slot * SIMPAGESIZE;
 
 	// Get pointer to page data in (simulated) physical memory
 	frame_ptr = &physmem[frame * SIMPAGESIZE];
 
-	// Seek to position in swap file where this page was stored
-	pos = lseek(swapfd, swap_offset, SEEK_SET);
-	if (pos != swap_offset) {
-		assert(pos == (off_t)-1);
-		perror("swap_pagein: failed to set read position");
-		return -errno;
+	if (!swap_use_file) {
+		memcpy(frame_ptr, &swapmem[swap_offset], SIMPAGESIZE);
+		return 0;
 	}
 
-	// Read page data from swapfile into memory
-	bytes_read = read(swapfd, frame_ptr, SIMPAGESIZE);
+	// Read page data from its position in swapfile into memory
+	bytes_read = pread(swapfd, frame_ptr, SIMPAGESIZE, swap_offset);
+	if (bytes_read == -1) {
+		perror("swap_pagein: failed to read page");
+		return -errno;
+	}
 	if (bytes_read != SIMPAGESIZE) {
 		fprintf(stderr,"swap_pagein: did not read whole page\n");
 		return bytes_read;
@@ -212,45 +257,67 @@ int swap_pagein(unsigned frame, int swap_offset) {
 	return 0;
 }
 
-// Write data from (simulated) physical memory 'frame' to 'swap_offset'
+// Write data from (simulated) physical memory 'frame' to 'swap_slot'
 // in swap file. Allocates space in swap file for virtual page if needed.
 // Input:  frame - the physical frame number (not byte offset in physmem)
-//         swap_offset - the byte position in the swap file.
-// Return: the swap_offset where the data was written on success,
+//         swap_slot - the slot (not byte offset) in the swap file.
+// Return: the swap_slot where the data was written on success,
 //         or INVALID_SWAP on failure
 //
-int swap_pageout(unsigned frame, int swap_offset) {
+static int pageout(unsigned frame, int swap_slot) {
 	char *frame_ptr;
-	off_t pos;
 	unsigned idx;
 	ssize_t bytes_written;
+	off_t swap_offset;
 
 	// Check if swap has already been allocated for this page
-	if (swap_offset == INVALID_SWAP) {
+	if (swap_slot == INVALID_SWAP) {
 		if (bitmap_alloc(swapmap, &idx) != 0) {
 			fprintf(stderr,"swap_pageout: Could not allocate space in swapfile. Try running again with a larger swapsize.\n");
 			return INVALID_SWAP;
 		}
-		swap_offset = idx*SIMPAGESIZE;
+		STATS_INC(swap_allocs);
+		swap_slot = idx;
 	}
-	assert(swap_offset != INVALID_SWAP);
+	assert(swap_slot != INVALID_SWAP);
+	swap_offset = (off_t)swap_slot * SIMPAGESIZE;
 
 	// Get pointer to page data in (simulated) physical memory
 	frame_ptr = &physmem[frame * SIMPAGESIZE];
 
-	// Seek to position in swap file where this page will be stored
-	pos = lseek(swapfd, swap_offset, SEEK_SET);
-	if (pos != swap_offset) {
-		assert(pos == (off_t)-1);
-		perror("swap_pageout: failed to set write position");
-		return INVALID_SWAP;
+	if (!swap_use_file) {
+		memcpy(&swapmem[swap_offset], frame_ptr, SIMPAGESIZE);
+		return swap_slot;
 	}
 
-	// Read page data from swapfile into memory
-	bytes_written = write(swapfd, frame_ptr, SIMPAGESIZE);
+	// Write page data to its position in swapfile
+	bytes_written = pwrite(swapfd, frame_ptr, SIMPAGESIZE, swap_offset);
+	if (bytes_written == -1) {
+		perror("swap_pageout: failed to write page");
+		return INVALID_SWAP;
+	}
 	if (bytes_written != SIMPAGESIZE) {
 		fprintf(stderr,"swap_pageout: did not write whole page\n");
 		return INVALID_SWAP;
 	}
-	return swap_offset;
+	return swap_slot;
+}
+
+// The swap I/O phase of the instrumentation (stats.h) is timed here.
+int swap_pagein(unsigned frame, int swap_slot) {
+	int ret;
+	STATS_START(start);
+
+	ret = pagein(frame, swap_slot);
+	STATS_STOP(PHASE_SWAP, start);
+	return ret;
+}
+
+int swap_pageout(unsigned frame, int swap_slot) {
+	int ret;
+	STATS_START(start);
+
+	ret = pageout(frame, swap_slot);
+	STATS_STOP(PHASE_SWAP, start);
+	return ret;
 }
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "sim.h"
+#include "trace.h"
+
+/* Set-associative TLB, with an optional second level.
+ *
+ * Entries are tagged with the pid, so there is no flush when the trace
+ * switches process, and hold a pointer to the page table entry of the page:
+ * a hit skips the page walk in find_physpage. The page table entry still
+ * gets its reference and dirty bits and the replacement algorithm still
+ * sees the reference, so a TLB changes walk counts and simulated time, never
+ * hits or misses. An entry is invalidated when its page is evicted.
+ *
+ * A miss in the first level looks in the second, and a miss there walks the
+ * page table. Both levels are filled after a walk. A huge page (see
+ * hugepage.c) takes one entry for the whole region.
+ */
+
+// Geometry, shared by all simulations (sim -T). No TLB if tlb_entries is 0.
+unsigned tlb_entries = 0;
+unsigned tlb_ways = 1;
+unsigned tlb2_entries = 0;
+unsigned tlb2_ways = 1;
+int tlb_random = 0;      // Random instead of LRU replacement within a set
+
+__thread int tlb_hit_count;
+__thread int tlb2_hit_count;
+__thread int walk_count;
+
+#define TLB_EMPTY ((addr_t)-1)
+#define TAG_HUGE  ((addr_t)1 << (TRACE_PID_SHIFT - 1))
+
+struct tlb {
+	unsigned sets;
+	unsigned ways;
+	addr_t *tags;           // sets * ways tags, TLB_EMPTY if invalid
+	pgtbl_entry_t **ptes;   // Entry for the (first) page of each tag
+	unsigned *stamp;        // Time of last use of each entry, for LRU
+	unsigned clock;
+};
+
+static __thread struct tlb l1, l2;
+static __thread unsigned seed;
+
+static void tlb_create(struct tlb *t, unsigned entries, unsigned ways) {
+	unsigned i;
+
+	t->ways = ways;
+	t->sets = entries / ways;
+	t->clock = 0;
+	t->tags = malloc(entries * sizeof(addr_t));
+	t->ptes = malloc(entries * sizeof(pgtbl_entry_t *));
+	t->stamp = calloc(entries, sizeof(unsigned));
+	if (t->tags == NULL || t->ptes == NULL || t->stamp == NULL) {
+		perror("Failed to allocate TLB");
+		exit(1);
+	}
+	for (i = 0; i < entries; i++) {
+		t->tags[i] = TLB_EMPTY;
+	}
+}
+
+static void tlb_free(struct tlb *t) {
+	free(t->tags);
+	free(t->ptes);
+	free(t->stamp);
+	t->tags = NULL;
+	t->ptes = NULL;
+	t->stamp = NULL;
+}
+
+/* Returns the index of tag in t, or -1 if it is not there. index is the
+ * page or huge page number used to pick the set.
+ */
+static int tlb_find(struct tlb *t, addr_t tag, addr_t index) {
+	unsigned base = (index % t->sets) * t->ways;
+	unsigned i;
+
+	for (i = base; i < base + t->ways; i++) {
+		if (t->tags[i] == tag) {
+			t->stamp[i] = ++t->clock;
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void tlb_insert(struct tlb *t, addr_t tag, addr_t index,
+		       pgtbl_entry_t *p) {
+	unsigned base = (index % t->sets) * t->ways;
+	unsigned i, victim = base;
+
+	if (tlb_random) {
+		victim = base + rand_r(&seed) % t->ways;
+		for (i = base; i < base + t->ways; i++) {
+			if (t->tags[i] == TLB_EMPTY) {
+				victim = i;
+				break;
+			}
+		}
+	} else {
+		for (i = base; i < base + t->ways; i++) {
+			if (t->tags[i] == TLB_EMPTY) {
+				victim = i;
+				break;
+			}
+			if (t->stamp[i] < t->stamp[victim])
+				victim = i;
+		}
+	}
+	t->tags[victim] = tag;
+	t->ptes[victim] = p;
+	t->stamp[victim] = ++t->clock;
+}
+
+static void tlb_remove(struct tlb *t, addr_t tag, addr_t index) {
+	int i = tlb_find(t, tag, index);
+
+	if (i != -1)
+		t->tags[i] = TLB_EMPTY;
+}
+
+void tlb_init() {
+	tlb_create(&l1, tlb_entries, tlb_ways);
+	if (tlb2_entries > 0)
+		tlb_create(&l2, tlb2_entries, tlb2_ways);
+	tlb_hit_count = tlb2_hit_count = walk_count = 0;
+	seed = 1;
+}
+
+void tlb_destroy() {
+	tlb_free(&l1);
+	if (tlb2_entries > 0)
+		tlb_free(&l2);
+}
+
+/* Looks up vaddr of the current process. Returns its page table entry, or
+ * NULL if the page table must be walked (counted as a walk).
+ */
+pgtbl_entry_t *tlb_lookup(addr_t vaddr) {
+	addr_t page = vaddr >> PAGE_SHIFT;
+	addr_t tag = ((addr_t)cur_proc->pid << TRACE_PID_SHIFT) | page;
+	int i;
+
+	if (huge_pages > 0) {
+		addr_t region = page / huge_pages;
+		addr_t htag = ((addr_t)cur_proc->pid << TRACE_PID_SHIFT) |
+			TAG_HUGE | region;
+
+		if ((i = tlb_find(&l1, htag, region)) != -1) {
+			tlb_hit_count++;
+			return l1.ptes[i] + page % huge_pages;
+		}
+		if (tlb2_entries > 0 &&
+		    (i = tlb_find(&l2, htag, region)) != -1) {
+			tlb2_hit_count++;
+			tlb_insert(&l1, htag, region, l2.ptes[i]);
+			return l2.ptes[i] + page % huge_pages;
+		}
+	}
+	if ((i = tlb_find(&l1, tag, page)) != -1) {
+		tlb_hit_count++;
+		return l1.ptes[i];
+	}
+	if (tlb2_entries > 0 && (i = tlb_find(&l2, tag, page)) != -1) {
+		tlb2_hit_count++;
+		tlb_insert(&l1, tag, page, l2.ptes[i]);
+		return l2.ptes[i];
+	}
+	walk_count++;
+	return NULL;
+}
+
+/* Adds the translation of vaddr of the current process, to page table entry
+ * p, to both levels after a walk.
+ */
+void tlb_fill(addr_t vaddr, pgtbl_entry_t *p) {
+	addr_t page = vaddr >> PAGE_SHIFT;
+	addr_t tag = ((addr_t)cur_proc->pid << TRACE_PID_SHIFT) | page;
+	addr_t index = page;
+
+	if (huge_pages > 0 && huge_is_mapped(cur_proc->pid, vaddr)) {
+		// Regions are aligned runs of one second-level table, so the
+		// entries of their pages are contiguous.
+		index = page / huge_pages;
+		tag = ((addr_t)cur_proc->pid << TRACE_PID_SHIFT) | TAG_HUGE |
+			index;
+		p -= page % huge_pages;
+	}
+	tlb_insert(&l1, tag, index, p);
+	if (tlb2_entries > 0)
+		tlb_insert(&l2, tag, index, p);
+}
+
+/* Drops the translation of vaddr of process pid, and that of its huge page
+ * if any, from both levels.
+ */
+void tlb_invalidate(int pid, addr_t vaddr) {
+	addr_t page = vaddr >> PAGE_SHIFT;
+	addr_t tag = ((addr_t)pid << TRACE_PID_SHIFT) | page;
+
+	tlb_remove(&l1, tag, page);
+	if (tlb2_entries > 0)
+		tlb_remove(&l2, tag, page);
+	if (huge_pages > 0) {
+		addr_t region = page / huge_pages;
+
+		tag = ((addr_t)pid << TRACE_PID_SHIFT) | TAG_HUGE | region;
+		tlb_remove(&l1, tag, region);
+		if (tlb2_entries > 0)
+			tlb_remove(&l2, tag, region);
+	}
+}
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "trace.h"
+
+// Access types, in the order of their 2-bit codes in binary records.
+static const char type_codes[] = "ILSM";
+
+static unsigned type_code(char type) {
+	const char *c = strchr(type_codes, type);
+	return (c != NULL && type != '\0') ? c - type_codes : 0;
+}
+
+// Packs one access into a record without delta encoding.
+uint64_t trace_pack_ref(char type, addr_t vaddr, int pid) {
+	return ((uint64_t)(uint16_t)pid << TRACE_PID_SHIFT) |
+		((uint64_t)(vaddr >> PAGE_SHIFT) << 2) | type_code(type);
+}
+
+// Reads a LEB128 varint at t->pos. Returns 0 if the trace ends first.
+static int read_varint(struct trace *t, uint64_t *val) {
+	unsigned shift = 0;
+
+	*val = 0;
+	do {
+		if (t->pos >= t->end) {
+			fprintf(stderr, "trace: truncated record\n");
+			return 0;
+		}
+		*val |= (uint64_t)(*t->pos & 0x7f) << shift;
+		shift += 7;
+	} while (*t->pos++ & 0x80);
+	return 1;
+}
+
+// Appends val to fp as a LEB128 varint.
+static void write_varint(FILE *fp, uint64_t val) {
+	unsigned char buf[10];
+	int n = 0;
+
+	do {
+		buf[n] = val & 0x7f;
+		val >>= 7;
+		if (val != 0)
+			buf[n] |= 0x80;
+		n++;
+	} while (val != 0);
+	fwrite(buf, 1, n, fp);
+}
+
+/*
+ * Opens the trace file name, or stdin if name is NULL, and detects its
+ * format. Binary traces are mapped into memory and replayed from there.
+ * Exits on error, like the rest of the simulator's setup code.
+ */
+void trace_open(struct trace *t, const char *name) {
+	struct trace_header hdr;
+	struct stat st;
+
+	memset(t, 0, sizeof(*t));
+	if (name == NULL) {
+		// Can't look ahead on a pipe, so stdin is always text.
+		t->fp = stdin;
+		return;
+	}
+	if ((t->fp = fopen(name, "r")) == NULL) {
+		perror("Error opening tracefile:");
+		exit(1);
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, t->fp) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0) {
+		rewind(t->fp);
+		return;
+	}
+	if (hdr.version != TRACE_VERSION) {
+		fprintf(stderr, "%s: unsupported trace version %u\n",
+			name, hdr.version);
+		exit(1);
+	}
+
+	if (fstat(fileno(t->fp), &st) != 0) {
+		perror("Error reading tracefile size:");
+		exit(1);
+	}
+	t->map_len = st.st_size;
+	t->map = mmap(NULL, t->map_len, PROT_READ, MAP_PRIVATE,
+		      fileno(t->fp), 0);
+	if (t->map == MAP_FAILED) {
+		perror("Error mapping tracefile:");
+		exit(1);
+	}
+	madvise(t->map, t->map_len, MADV_SEQUENTIAL);
+	fclose(t->fp);
+	t->fp = NULL;
+
+	t->flags = hdr.flags;
+	t->num_refs = hdr.num_refs;
+	t->pos = t->map + sizeof(hdr);
+	t->end = t->map + t->map_len;
+	if (!(t->flags & TRACE_DELTA) &&
+	    (t->end - t->pos) / sizeof(uint64_t) < t->num_refs) {
+		fprintf(stderr, "%s: trace is truncated\n", name);
+		exit(1);
+	}
+	if (!(t->flags & TRACE_DELTA)) {
+		t->end = t->pos + t->num_refs * sizeof(uint64_t);
+	}
+}
+
+/*
+ * Sets up t to read num_refs binary records (without delta encoding) from
+ * memory. The records are not copied and must outlive t.
+ */
+void trace_from_records(struct trace *t, const uint64_t *recs,
+			uint64_t num_refs) {
+	memset(t, 0, sizeof(*t));
+	t->num_refs = num_refs;
+	t->pos = (const unsigned char *)recs;
+	t->end = (const unsigned char *)(recs + num_refs);
+}
+
+/*
+ * Reads the next memory access from the trace.
+ * Return: 1 with type and vaddr set, or 0 at the end of the trace.
+ */
+int trace_next(struct trace *t, char *type, addr_t *vaddr) {
+	char buf[MAXLINE];
+	uint64_t rec;
+
+	if (t->fp != NULL) {
+		while (fgets(buf, MAXLINE, t->fp) != NULL) {
+			if (buf[0] != '=') {
+				t->pid = 0;
+				sscanf(buf, "%c %lx %d", type, vaddr, &t->pid);
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	if (t->pos >= t->end)
+		return 0;
+
+	if (t->flags & TRACE_DELTA) {
+		int64_t delta;
+		uint64_t pid = 0;
+
+		if (!read_varint(t, &rec))
+			return 0;
+		if ((t->flags & TRACE_PID) && !read_varint(t, &pid))
+			return 0;
+
+		delta = (int64_t)((rec >> 2) >> 1) ^ -(int64_t)((rec >> 2) & 1);
+		t->last_page += delta;
+		*vaddr = t->last_page << PAGE_SHIFT;
+		t->pid = (int)pid;
+	} else {
+		memcpy(&rec, t->pos, sizeof(rec));
+		t->pos += sizeof(rec);
+		*vaddr = (addr_t)((rec & ((1ULL << TRACE_PID_SHIFT) - 1)) >> 2)
+			<< PAGE_SHIFT;
+		t->pid = (int)(rec >> TRACE_PID_SHIFT);
+	}
+	*type = type_codes[rec & 0x3];
+	return 1;
+}
+
+/*
+ * Reads the rest of the trace into memory as binary records without delta
+ * encoding, so it can be replayed any number of times with
+ * trace_from_records. A binary trace that is not delta encoded is used in
+ * place. Either way the records stay valid until trace_close(t).
+ * Return: the records, with their number in num_refs.
+ */
+uint64_t *trace_load(struct trace *t, uint64_t *num_refs) {
+	uint64_t cap, n = 0;
+	char type;
+	addr_t vaddr;
+
+	if (t->map != NULL && !(t->flags & TRACE_DELTA)) {
+		*num_refs = (t->end - t->pos) / sizeof(uint64_t);
+		return (uint64_t *)t->pos;
+	}
+
+	cap = t->num_refs > 0 ? t->num_refs : 1024;
+	if ((t->recs = malloc(cap * sizeof(uint64_t))) == NULL) {
+		perror("Failed to allocate memory for trace");
+		exit(1);
+	}
+	while (trace_next(t, &type, &vaddr)) {
+		if (n == cap) {
+			cap *= 2;
+			t->recs = realloc(t->recs, cap * sizeof(uint64_t));
+			if (t->recs == NULL) {
+				perror("Failed to allocate memory for trace");
+				exit(1);
+			}
+		}
+		t->recs[n++] = trace_pack_ref(type, vaddr, t->pid);
+	}
+	*num_refs = n;
+	return t->recs;
+}
+
+void trace_close(struct trace *t) {
+	free(t->recs);
+	if (t->map != NULL) {
+		munmap(t->map, t->map_len);
+	} else if (t->fp != NULL && t->fp != stdin) {
+		fclose(t->fp);
+	}
+	memset(t, 0, sizeof(*t));
+}
+
+/*
+ * Writes a binary trace header to fp.
+ */
+void trace_write_header(FILE *fp, uint32_t flags, uint64_t num_refs) {
+	struct trace_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.flags = flags;
+	hdr.num_refs = num_refs;
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+}
+
+/*
+ * Appends one memory access to a binary trace. last_page holds the
+ * previous page written, and must start at 0 for delta encoded traces.
+ * pid is dropped from delta encoded traces without TRACE_PID.
+ */
+void trace_write_ref(FILE *fp, uint32_t flags, char type, addr_t vaddr,
+		     int pid, addr_t *last_page) {
+	addr_t page = vaddr >> PAGE_SHIFT;
+	uint64_t rec;
+
+	if (flags & TRACE_DELTA) {
+		int64_t delta = (int64_t)(page - *last_page);
+
+		rec = ((uint64_t)((delta << 1) ^ (delta >> 63)) << 2) |
+			type_code(type);
+		write_varint(fp, rec);
+		if (flags & TRACE_PID)
+			write_varint(fp, (uint16_t)pid);
+		*last_page = page;
+	} else {
+		rec = trace_pack_ref(type, vaddr, pid);
+		fwrite(&rec, sizeof(rec), 1, fp);
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pagetable.h"
+
+/* Traces come in two formats. The text format is what fastslim produces,
+ * one "<type> <hex vaddr> [pid]" line per memory access, where lines
+ * starting with '=' are ignored. The binary format is a struct trace_header
+ * followed by one record per memory access, written in host byte order:
+ *
+ *   - by default each record is a uint64_t holding
+ *     (pid << TRACE_PID_SHIFT) | (page << 2) | type code
+ *   - with TRACE_DELTA each record is a LEB128 varint holding
+ *     (zigzag(page - previous page) << 2) | type code, followed by the pid
+ *     as another varint if TRACE_PID is set
+ *
+ * The pid tags the process (address space) making the access, from 0 to
+ * 65535. Traces of a single process leave it out, and it is 0.
+ *
+ * Only page numbers are kept, so a binary trace replays as page aligned
+ * addresses. Use trconv to convert a text trace.
+ */
+#define TRACE_MAGIC     "SIMTRACE"
+#define TRACE_VERSION   1
+#define TRACE_DELTA     (0x1) // Records are delta encoded varints
+#define TRACE_PID       (0x2) // Delta encoded records are followed by a pid
+#define TRACE_PID_SHIFT 48
+
+struct trace_header {
+	char magic[8];          // TRACE_MAGIC, without the terminating '\0'
+	uint32_t version;       // TRACE_VERSION
+	uint32_t flags;         // TRACE_DELTA or 0
+	uint64_t num_refs;      // Number of records that follow
+};
+
+struct trace {
+	FILE *fp;                     // Text traces are read with stdio
+	unsigned char *map;           // Binary traces are mmapped
+	size_t map_len;
+	const unsigned char *pos;     // Next record in map
+	const unsigned char *end;
+	uint32_t flags;
+	uint64_t num_refs;            // Number of references, 0 if unknown
+	addr_t last_page;             // Previous page, for delta decoding
+	int pid;                      // Process of the last access read
+	uint64_t *recs;               // Records decoded by trace_load
+};
+
+extern void trace_open(struct trace *t, const char *name);
+extern void trace_from_records(struct trace *t, const uint64_t *recs,
+			       uint64_t num_refs);
+extern int trace_next(struct trace *t, char *type, addr_t *vaddr);
+extern uint64_t *trace_load(struct trace *t, uint64_t *num_refs);
+extern void trace_close(struct trace *t);
+
+extern uint64_t trace_pack_ref(char type, addr_t vaddr, int pid);
+extern void trace_write_header(FILE *fp, uint32_t flags, uint64_t num_refs);
+extern void trace_write_ref(FILE *fp, uint32_t flags, char type, addr_t vaddr,
+			    int pid, addr_t *last_page);
+
+#endif /* __TRACE_H__ */
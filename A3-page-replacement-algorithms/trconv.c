@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "sim.h"
+#include "trace.h"
+
+/* Converts a trace (normally a text tr-*.ref file) to the binary format
+ * described in trace.h, so that sim can replay it without parsing.
+ */
+int main(int argc, char *argv[]) {
+	int opt;
+	uint32_t flags = 0;
+	struct trace in;
+	FILE *outfp;
+	char type;
+	addr_t vaddr;
+	addr_t last_page = 0;
+	uint64_t num_refs = 0;
+	char *usage = "USAGE: trconv [-d [-p]] tracefile outfile\n"
+		"  -d  delta encode page numbers (smaller, same replay)\n"
+		"  -p  keep process ids in a delta encoded trace\n";
+
+	while ((opt = getopt(argc, argv, "dp")) != -1) {
+		switch (opt) {
+		case 'd':
+			flags |= TRACE_DELTA;
+			break;
+		case 'p':
+			flags |= TRACE_PID;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (argc - optind != 2) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+
+	trace_open(&in, argv[optind]);
+	if ((outfp = fopen(argv[optind + 1], "w")) == NULL) {
+		perror("Error opening output file:");
+		exit(1);
+	}
+
+	// The header is rewritten with the real count at the end.
+	trace_write_header(outfp, flags, 0);
+	while (trace_next(&in, &type, &vaddr)) {
+		if (in.pid != 0 && (flags & TRACE_DELTA) &&
+		    !(flags & TRACE_PID)) {
+			fprintf(stderr, "trconv: the trace has process ids, "
+				"use -p to keep them\n");
+			exit(1);
+		}
+		trace_write_ref(outfp, flags, type, vaddr, in.pid, &last_page);
+		num_refs++;
+	}
+	trace_close(&in);
+
+	rewind(outfp);
+	trace_write_header(outfp, flags, num_refs);
+	if (fclose(outfp) != 0) {
+		perror("Error writing output file:");
+		exit(1);
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "pagetable.h"
+#include "pagelist.h"
+#include "sim.h"
+
+
+extern int debug;
+
+/* The full 2Q algorithm (Johnson and Shasha, VLDB 1994).
+ *
+ * Pages seen for the first time go on A1in, a FIFO of resident pages. When
+ * they leave it they are remembered on A1out, a FIFO of ghosts. A page that
+ * is referenced again while on A1out is considered hot and goes on Am, an
+ * LRU list of resident pages. A page that only gets referenced during its
+ * time on A1in (like a page touched by a scan) never reaches Am.
+ *
+ * A page brought in without a reference (read ahead, or to fill a huge
+ * page) goes on A1in too, and leaves no ghost if it is not referenced there.
+ */
+#define UNREF (0x1)  // Brought in without a reference, not referenced since
+
+static __thread struct pl_pool pool;
+static __thread struct pl_list a1in, a1out, am;
+static __thread int kin;     // Size A1in may grow to before it gives up pages
+static __thread int kout;    // Most ghosts kept on A1out
+
+/* Page to evict is chosen using the 2Q algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int twoq_evict() {
+	int n, frame;
+
+	if (a1in.len > kin || am.len == 0) {
+		// Move the oldest page on A1in to A1out, forgetting the oldest
+		// ghost if A1out is full.
+		n = a1in.head;
+		pl_remove(&pool, &a1in, n);
+		if (PL_NODE(&pool, n)->flags & UNREF) {
+			frame = PL_NODE(&pool, n)->frame;
+			pl_free(&pool, n);
+			return frame;
+		}
+		if (a1out.len == kout) {
+			int old = a1out.head;
+			pl_remove(&pool, &a1out, old);
+			pl_free(&pool, old);
+		}
+		pl_push(&pool, &a1out, n);
+		return pl_make_ghost(&pool, n);
+	}
+
+	// Evict the least recently used hot page, without a ghost.
+	n = am.head;
+	pl_remove(&pool, &am, n);
+	frame = PL_NODE(&pool, n)->frame;
+	pl_free(&pool, n);
+	return frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the 2q algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void twoq_ref(pgtbl_entry_t *p) {
+	int frame = p->frame >> PAGE_SHIFT;
+	int n = pl_find(&pool, p);
+	struct pl_node *node;
+
+	if (n == -1) {
+		// First time seen (or forgotten): onto A1in.
+		n = pl_new(&pool, p);
+		pl_set_frame(&pool, n, frame);
+		pl_push(&pool, &a1in, n);
+		return;
+	}
+
+	node = PL_NODE(&pool, n);
+	if (node->on[0] == &am) {
+		// Hit on a hot page: move to the most recently used end.
+		pl_remove(&pool, &am, n);
+		pl_push(&pool, &am, n);
+	} else if (node->on[0] == &a1out) {
+		// Seen again after leaving A1in: the page is hot.
+		pl_remove(&pool, &a1out, n);
+		pl_set_frame(&pool, n, frame);
+		pl_push(&pool, &am, n);
+	}
+	// A hit on A1in does not change its place.
+	node->flags &= ~UNREF;
+}
+
+/* This function is called when a page is brought in without a reference
+ * (read ahead, or to fill a huge page). Any ghost of the page on A1out is
+ * forgotten, as this is not a reference.
+ */
+void twoq_insert(pgtbl_entry_t *p) {
+	int n = pl_find(&pool, p);
+
+	if (n != -1) {
+		pl_remove(&pool, &a1out, n);
+		pl_free(&pool, n);
+	}
+	n = pl_new(&pool, p);
+	pl_set_frame(&pool, n, p->frame >> PAGE_SHIFT);
+	PL_NODE(&pool, n)->flags = UNREF;
+	pl_push(&pool, &a1in, n);
+}
+
+/* Initializes any data structures needed for this
+ * replacement algorithm.
+ */
+void twoq_init() {
+	// The sizes suggested in the paper: A1in gets a quarter of memory and
+	// A1out remembers half as many pages as fit in memory.
+	kin = memsize / 4 > 0 ? memsize / 4 : 1;
+	kout = memsize / 2 > 0 ? memsize / 2 : 1;
+
+	pl_pool_init(&pool, memsize + kout + 1);
+	pl_list_init(&a1in, 0);
+	pl_list_init(&a1out, 0);
+	pl_list_init(&am, 0);
+}
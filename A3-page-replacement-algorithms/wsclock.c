@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "pagetable.h"
+#include "sim.h"
+#include "stats.h"
+
+extern int debug;
+
+// Virtual time is the number of references made so far (ref_count).
+// last_use[frame] is the virtual time at which the page in frame was last
+// seen referenced by the hand, or brought in. Pages used within the last
+// wsclock_window references are in the working set.
+static __thread int *last_use;
+static __thread int hand;
+
+/* Page to evict is chosen using the WSClock algorithm.
+ * The hand clears reference bits like clock, and stops at the first clean
+ * page that has left the working set. An old page that is dirty is not
+ * evicted: its write-back is scheduled (clean_frame) and the hand moves on,
+ * so that it can be evicted clean later. Write-backs complete at once in the
+ * simulator, so if the first round only scheduled writes the second round
+ * finds those pages clean.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int wsclock_evict() {
+
+	int fallback = -1;  // First clean page seen, if no page is old
+	unsigned n;
+
+	for (n = 0; n < 2 * memsize; n++) {
+		int frame = hand;
+		pgtbl_entry_t *p = coremap.pte[frame];
+
+		hand = (hand + 1) % memsize;
+		if (!frame_evictable(frame)) {
+			continue; // Under local replacement, not a candidate
+		} else if (p->frame & PG_REF) {
+			p->frame &= ~PG_REF;
+			last_use[frame] = ref_count;
+		} else if ((unsigned)(ref_count - last_use[frame]) <=
+			   wsclock_window) {
+			if (fallback == -1 && !(p->frame & PG_DIRTY))
+				fallback = frame;
+		} else if (p->frame & PG_DIRTY) {
+			clean_frame(frame);
+		} else {
+			STATS_SCAN(n + 1);
+			return frame;
+		}
+	}
+	STATS_SCAN(n);
+
+	// The whole working set is in memory: evict a clean page if there is
+	// one, or the next page that may be taken.
+	if (fallback != -1)
+		return fallback;
+	while (!frame_evictable(hand))
+		hand = (hand + 1) % memsize;
+	n = hand;
+	hand = (hand + 1) % memsize;
+	return n;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the WSClock algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void wsclock_ref(pgtbl_entry_t *p) {
+
+	// The page table sets the reference bit, the hand reads it.
+	return;
+}
+
+/* This function is called by allocate_frame each time a frame is given to a
+ * new page.
+ */
+void wsclock_alloc(int frame) {
+	last_use[frame] = ref_count;
+}
+
+/* This function is called when a page is brought in without a reference
+ * (read ahead, or to fill a huge page). It has not been used, so it starts
+ * outside the working set.
+ */
+void wsclock_insert(pgtbl_entry_t *p) {
+	last_use[p->frame >> PAGE_SHIFT] = ref_count - wsclock_window - 1;
+}
+
+/* Initialize any data structures needed for this replacement
+ * algorithm.
+ */
+void wsclock_init() {
+
+	// Free what an earlier simulation on this thread left, if any.
+	free(last_use);
+	if ((last_use = calloc(memsize, sizeof(int))) == NULL) {
+		perror("wsclock: failed to allocate last use times");
+		exit(1);
+	}
+	hand = 0;
+}